@@ -29,6 +29,14 @@ typedef struct {
 	volatile uint32_t AFR[2];
 } GPIO_TypeDef;
 
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
 #define GPIO_MODE_OUTPUT_PP 0x01U
 #define GPIO_NOPULL 0x00U
 #define GPIO_SPEED_FREQ_VERY_HIGH 0x03U
@@ -37,6 +45,9 @@ typedef struct {
 #define GPIO_PIN_SET 1U
 #endif
 
+typedef struct TIM_HandleTypeDef TIM_HandleTypeDef;
+typedef struct __DMA_HandleTypeDef DMA_HandleTypeDef;
+
 void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
 void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, uint8_t PinState);
 
@@ -52,6 +63,8 @@ extern GPIO_TypeDef* GPIOD;
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "CriticalSection.h"
+#include "JsonTokenizer.h"
 
 // Matrix dimensions
 #define NUM_ROWS 10
@@ -111,20 +124,316 @@ extern GPIO_TypeDef* GPIOD;
 #define COL13_PORT GPIOD
 #define COL13_PIN GPIO_PIN_5
 
+// Compile-time view of the pin macros above: RowLine<n>/ColLine<n> give the
+// port and pin of a line as constants, so fixed-index writes resolve to an
+// immediate store to a constant BSRR address.
+template<uint8_t Row> struct RowLine;
+template<uint8_t Col> struct ColLine;
+
+#define ARRAY_ROW_LINE(n) \
+    template<> struct RowLine<n> { \
+        static inline GPIO_TypeDef* port() { return ROW##n##_PORT; } \
+        static constexpr uint32_t pin = ROW##n##_PIN; \
+    }
+#define ARRAY_COL_LINE(n) \
+    template<> struct ColLine<n> { \
+        static inline GPIO_TypeDef* port() { return COL##n##_PORT; } \
+        static constexpr uint32_t pin = COL##n##_PIN; \
+    }
+
+ARRAY_ROW_LINE(0); ARRAY_ROW_LINE(1); ARRAY_ROW_LINE(2); ARRAY_ROW_LINE(3); ARRAY_ROW_LINE(4);
+ARRAY_ROW_LINE(5); ARRAY_ROW_LINE(6); ARRAY_ROW_LINE(7); ARRAY_ROW_LINE(8); ARRAY_ROW_LINE(9);
+ARRAY_COL_LINE(0); ARRAY_COL_LINE(1); ARRAY_COL_LINE(2); ARRAY_COL_LINE(3); ARRAY_COL_LINE(4);
+ARRAY_COL_LINE(5); ARRAY_COL_LINE(6); ARRAY_COL_LINE(7); ARRAY_COL_LINE(8); ARRAY_COL_LINE(9);
+ARRAY_COL_LINE(10); ARRAY_COL_LINE(11); ARRAY_COL_LINE(12); ARRAY_COL_LINE(13);
+
+// Bit-packed electrode frame: one 16-bit word per row, bit N = column N
+#define FRAME_ROW_MASK ((uint16_t)((1U << NUM_COLS) - 1U))
+
+typedef struct {
+    uint16_t rows[NUM_ROWS];
+} ElectrodeFrame_t;
+
+// Frame operations (word-wide, no per-electrode loops)
+static inline void frameClear(ElectrodeFrame_t* frame) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) frame->rows[row] = 0;
+}
+
+static inline void frameFill(ElectrodeFrame_t* frame) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) frame->rows[row] = FRAME_ROW_MASK;
+}
+
+static inline bool frameGet(const ElectrodeFrame_t* frame, uint8_t row, uint8_t col) {
+    return (frame->rows[row] >> col) & 1U;
+}
+
+static inline void frameSet(ElectrodeFrame_t* frame, uint8_t row, uint8_t col, bool state) {
+    if (state) {
+        frame->rows[row] |= (uint16_t)(1U << col);
+    } else {
+        frame->rows[row] &= (uint16_t)~(1U << col);
+    }
+}
+
+static inline bool frameEquals(const ElectrodeFrame_t* a, const ElectrodeFrame_t* b) {
+    return memcmp(a->rows, b->rows, sizeof(a->rows)) == 0;
+}
+
+// out = a ^ b (electrodes that differ between two frames)
+static inline void frameXor(ElectrodeFrame_t* out, const ElectrodeFrame_t* a, const ElectrodeFrame_t* b) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) out->rows[row] = a->rows[row] ^ b->rows[row];
+}
+
+// out = a & b (electrodes active in both frames)
+static inline void frameAnd(ElectrodeFrame_t* out, const ElectrodeFrame_t* a, const ElectrodeFrame_t* b) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) out->rows[row] = a->rows[row] & b->rows[row];
+}
+
+// out = a | b (electrodes active in either frame)
+static inline void frameOr(ElectrodeFrame_t* out, const ElectrodeFrame_t* a, const ElectrodeFrame_t* b) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) out->rows[row] = a->rows[row] | b->rows[row];
+}
+
+// out = a & ~b (electrodes active in a but not in b)
+static inline void frameAndNot(ElectrodeFrame_t* out, const ElectrodeFrame_t* a, const ElectrodeFrame_t* b) {
+    for (uint8_t row = 0; row < NUM_ROWS; row++) out->rows[row] = a->rows[row] & (uint16_t)~b->rows[row];
+}
+
+// Position of the first active electrode; false if the frame is empty
+static inline bool frameFirst(const ElectrodeFrame_t* frame, uint8_t* row, uint8_t* col) {
+    for (uint8_t r = 0; r < NUM_ROWS; r++) {
+        if (frame->rows[r]) {
+            *row = r;
+            *col = (uint8_t)__builtin_ctz(frame->rows[r]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Number of active electrodes
+static inline uint16_t frameCount(const ElectrodeFrame_t* frame) {
+    uint16_t count = 0;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) count += __builtin_popcount(frame->rows[row]);
+    return count;
+}
+
+// Bitmask of rows with at least one active electrode
+static inline uint16_t frameActiveRows(const ElectrodeFrame_t* frame) {
+    uint16_t mask = 0;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        if (frame->rows[row]) mask |= (uint16_t)(1U << row);
+    }
+    return mask;
+}
+
+// Bitmask of columns with at least one active electrode
+static inline uint16_t frameActiveCols(const ElectrodeFrame_t* frame) {
+    uint16_t mask = 0;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) mask |= frame->rows[row];
+    return mask;
+}
+
+// FNV-1a hash of the frame words
+static inline uint32_t frameHash(const ElectrodeFrame_t* frame) {
+    uint32_t hash = 2166136261U;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        hash = (hash ^ (frame->rows[row] & 0xFFU)) * 16777619U;
+        hash = (hash ^ (frame->rows[row] >> 8)) * 16777619U;
+    }
+    return hash;
+}
+
+// CRC-32 (IEEE 802.3, reflected), continued from 'crc'
+static inline uint32_t crc32Update(uint32_t crc, const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+// Maximum number of distinct GPIO ports used by row/column lines (GPIOA-GPIOD)
+#define MAX_GPIO_PORTS 4
+
+// Row-scan refresh timer: the timer prescaler must be configured so the
+// counter runs at SCAN_TIMER_CLOCK_HZ; the driver programs ARR and CCR1.
+#define SCAN_TIMER_CLOCK_HZ 1000000U
+#define SCAN_MIN_ROW_TICKS 10U
+#define SCAN_MAX_ROW_TICKS 65536U
+
 // GPIO pin structure for efficient access
 typedef struct {
     GPIO_TypeDef* port;
     uint16_t pin;
 } GPIO_Pin_t;
 
+// Compiled mapping image (tools/MappingCompiler.cpp)
+// The JSON chain electrode -> PCIE pin -> row/col -> GPIO line resolved
+// offline into one block of byte tables, so the driver takes it as is:
+// copied into RAM with one memcpy, or used in place from flash. Fields are
+// little-endian; the CRC covers everything after the header.
+#define MAPPING_IMAGE_MAGIC 0x50414D45U     // "EMAP"
+#define MAPPING_IMAGE_VERSION 1
+
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+} ElectrodeMapping_t;
+
+// Row and column of an electrode or PCIE pin that the files leave unmapped
+#define MAPPING_UNMAPPED 0xFF
+
+// GPIO line as port index (0 = GPIOA, 1 = GPIOB, ...) and pin number (0-15)
+typedef struct {
+    uint8_t port;
+    uint8_t pin;
+} MappingLine_t;
+
+typedef struct {
+    uint32_t magic;         // MAPPING_IMAGE_MAGIC
+    uint16_t version;       // MAPPING_IMAGE_VERSION
+    uint16_t size;          // sizeof(MappingImage_t)
+    uint32_t crc;           // CRC-32 of the tables after the header
+    uint8_t rows;           // NUM_ROWS
+    uint8_t cols;           // NUM_COLS
+    uint8_t electrodes;     // NUM_ELECTRODES
+    uint8_t reserved;       // 0
+} MappingImageHeader_t;
+
+typedef struct {
+    MappingImageHeader_t header;
+    ElectrodeMapping_t electrodes[NUM_ELECTRODES];  // Electrode - 1 -> row/col (resolved, or unmapped)
+    uint8_t electrodeToPcie[NUM_ELECTRODES];        // Electrode - 1 -> PCIE pin (0: none)
+    ElectrodeMapping_t pcieToCell[NUM_ELECTRODES];  // PCIE pin - 1 -> row/col (or unmapped)
+    MappingLine_t rowLines[NUM_ROWS];
+    MappingLine_t colLines[NUM_COLS];
+} MappingImage_t;
+
+// Where the mapping in use came from
+typedef enum {
+    MAPPING_SOURCE_DEFAULT = 0,     // 1:1 fallback (mapping files missing or invalid)
+    MAPPING_SOURCE_JSON,            // ElectrodeMap.json + PinMap.json
+    MAPPING_SOURCE_IMAGE,           // Compiled image copied into RAM
+    MAPPING_SOURCE_IMAGE_IN_PLACE   // Compiled image used where it is (flash)
+} MappingSource_t;
+
+typedef enum {
+    MAPPING_RELOAD_OK = 0,
+    MAPPING_RELOAD_ERR_BUSY,            // Previous swap still waiting for a step edge
+    MAPPING_RELOAD_ERR_ELECTRODE_MAP,   // ElectrodeMap.json missing or invalid
+    MAPPING_RELOAD_ERR_PIN_MAP,         // PinMap.json missing or invalid
+    MAPPING_RELOAD_ERR_INVALID          // Resolved tables out of range or not a bijection
+} MappingReloadError_t;
+
+// Mapping check, run on every load and reload
+// The electrode -> PCIE pin -> row/col chain must be a bijection: every
+// electrode on its own PCIE pin, every PCIE pin on its own cell. Each count
+// comes with the lowest offending electrode or PCIE pin number, or cell
+// (row * NUM_COLS + col + 1); 0 when the count is 0. File entry counts are
+// only known for JSON loads (0 for compiled images).
+typedef struct {
+    MappingSource_t source;
+    MappingReloadError_t loadError;     // Why the JSON files were not used (DEFAULT source)
+    
+    // Entries skipped or overwritten while parsing
+    uint16_t electrodeEntriesIgnored;   // ElectrodeMap.json: electrode or PCIE pin outside 1-140
+    uint16_t electrodeDuplicates;       // ElectrodeMap.json: electrode listed again (last kept)
+    uint16_t pinEntriesIgnored;         // PinMap.json: cell off the matrix or PCIE pin outside 1-140
+    uint16_t pinDuplicates;             // PinMap.json: PCIE pin listed for another cell (last kept)
+    
+    // ElectrodeMap: electrode -> PCIE pin
+    uint8_t electrodesUnmapped;         // No PCIE pin
+    uint8_t firstElectrodeUnmapped;
+    uint8_t pcieShared;                 // PCIE pin of more than one electrode
+    uint8_t firstPcieShared;
+    
+    // PinMap: PCIE pin -> cell
+    uint8_t pcieUnmapped;               // No cell
+    uint8_t firstPcieUnmapped;
+    uint8_t cellsUnassigned;            // No PCIE pin points at the cell
+    uint8_t firstCellUnassigned;
+    
+    // Resolved: electrode -> cell
+    uint8_t electrodesUnresolved;       // No cell (getRowColFromElectrode() fails)
+    uint8_t firstElectrodeUnresolved;
+    uint8_t cellsShared;                // Cell of more than one electrode
+    uint8_t firstCellShared;
+    uint8_t cellsUnused;                // Cell of no electrode
+    uint8_t firstCellUnused;
+    
+    uint16_t problems;                  // Sum of all counts
+    bool bijective;                     // Every electrode has a cell of its own
+    uint32_t checkCycles;               // Cost of the table check
+} MappingReport_t;
+
+// Cost of the last reloadMapping()
+typedef struct {
+    uint32_t bytes;         // JSON read from both files
+    uint32_t parse_ms;      // Shadow tables built and checked (sequences keep running)
+    uint32_t parseCycles;
+    uint32_t swapCycles;    // Tables switched (valid once swapPending is false)
+    bool swapPending;       // Waiting for the next step edge
+    MappingReport_t check;  // Check of the reloaded tables
+} MappingReload_t;
+
+// Cycle counts measured by benchmarkPatternWrite()
+typedef struct {
+    uint32_t loopCycles;   // 140 x setElectrode() (one delta write each)
+    uint32_t maskCycles;   // Precompiled per-port BSRR masks (one critical section)
+    uint8_t portWrites;    // BSRR stores issued by the mask path
+    uint32_t deltaCycles;  // setPattern() of the frame with one electrode toggled
+    uint8_t deltaWrites;   // BSRR stores issued by that delta write
+} PatternBenchmark_t;
+
+// Per-call cost of a single-electrode write, averaged over on/off toggles
+// (instructions derived from the DWT CYCCNT/CPI/EXC/SLEEP/LSU/FOLD counters)
+typedef struct {
+    uint32_t runtimeCycles;        // setElectrode(row, col, state)
+    uint32_t runtimeInstructions;
+    uint32_t fixedCycles;          // setElectrodeFixed<row, col>(state)
+    uint32_t fixedInstructions;
+} ElectrodeWriteBenchmark_t;
+
+// Parse time of a generated ElectrodeMap.json-style document, measured by
+// benchmarkMappingParse()
+typedef struct {
+    uint16_t entries;      // "<electrode>": <PCIE pin> entries in the document
+    uint32_t bytes;        // Document size
+    uint32_t cycles;       // Tokenize and fill the table (generation excluded)
+    bool valid;            // Document parsed without error
+} MappingParseBenchmark_t;
+
 // Microfluidics/PCR Test Scenarios - Forward declarations
+// A step either sets one electrode (row, col, state) or, when 'frame' is
+// set, replaces the whole array with that frame in one transition.
 typedef struct {
     uint8_t row;
     uint8_t col;
     bool state;
     uint32_t duration_ms;  // Duration to hold this state
+    uint32_t duration_us;  // Added to duration_ms (sub-millisecond steps)
+    const ElectrodeFrame_t* frame;  // Target frame (nullptr: single electrode)
 } ElectrodeStep_t;
 
+// Hold time of a step in microseconds (step + cycle delay must stay < 71 min)
+static inline uint32_t stepDurationMicros(const ElectrodeStep_t* step) {
+    return step->duration_ms * 1000U + step->duration_us;
+}
+
+// Apply a step to a frame (ignores out-of-range single electrodes)
+static inline void stepApply(const ElectrodeStep_t* step, ElectrodeFrame_t* frame) {
+    if (step->frame) {
+        *frame = *step->frame;
+    } else if (step->row < NUM_ROWS && step->col < NUM_COLS) {
+        frameSet(frame, step->row, step->col, step->state);
+    }
+}
+
 typedef struct {
     ElectrodeStep_t* steps;
     uint16_t numSteps;
@@ -132,47 +441,178 @@ typedef struct {
     uint32_t cycleDelay_ms;  // Delay between cycles
 } ElectrodeSequence_t;
 
+// Progress of the asynchronous sequence engine
+typedef struct {
+    bool running;
+    bool paused;
+    uint8_t preempted;          // Interrupted runs waiting to resume
+    uint8_t priority;           // Priority of the running sequence
+    uint32_t cycle;             // Current cycle (0-based)
+    uint32_t cycleCount;
+    uint16_t step;              // Current step (0-based)
+    uint16_t numSteps;
+    uint32_t stepRemaining_ms;  // Until the next step (includes the cycle delay)
+    uint32_t totalRemaining_ms; // Until the sequence ends
+} SequenceProgress_t;
+
+// Step edge timing of the last sequence run. Every step is scheduled against
+// an absolute deadline from the start of the run, so lateness does not add
+// up: endDrift_us is how late the run ended, maxLatency_us the worst step.
+typedef struct {
+    uint32_t edges;          // Step edges, including the end of the run
+    uint32_t maxLatency_us;  // Worst edge lateness
+    uint32_t avgLatency_us;
+    uint32_t endDrift_us;    // Lateness of the last edge (the run end once finished)
+} SequenceTiming_t;
+
+// Runs a preemptSequence() call can interrupt at once (nested preemption)
+#define SEQUENCE_PREEMPT_DEPTH 2
+
+// Step timer for executeSequenceTimed(): a 32-bit timer (TIM2/TIM5) with its
+// counter at SEQUENCE_TIMER_CLOCK_HZ and ARR = 0xFFFFFFFF; the driver
+// programs CCR1 with absolute step deadlines.
+#define SEQUENCE_TIMER_CLOCK_HZ 1000000U
+#define SEQUENCE_MIN_LEAD_TICKS 2U  // Deadlines closer than this are applied at once
+
 class ArrayDriver {
 private:
-    // Row and column GPIO lookup tables
+    // Row and column GPIO lookup tables (header macros, or PinDef.json)
     GPIO_Pin_t rowPins[NUM_ROWS];
     GPIO_Pin_t colPins[NUM_COLS];
     
-    // Current state of electrodes (true = high, false = low)
-    bool electrodeState[NUM_ROWS][NUM_COLS];
+    // True while rowPins/colPins match the ROWn/COLn macros, i.e. the
+    // compile-time RowLine/ColLine writes address the right pins
+    bool pinLayoutFromMacros;
+    
+    // Distinct GPIO ports used by the lines, and the port index of each line.
+    // Whole-frame writes are folded into one BSRR word per port.
+    GPIO_TypeDef* gpioPorts[MAX_GPIO_PORTS];
+    uint8_t numGpioPorts;
+    uint8_t rowPortIndex[NUM_ROWS];
+    uint8_t colPortIndex[NUM_COLS];
+    
+    // Line levels last written by static drive (bit set = line driven), so
+    // pattern changes only touch lines whose level changes
+    uint16_t drivenRows;
+    uint16_t drivenCols;
+    bool drivenLinesValid;
+    
+    // Row-scan refresh engine: each row slot drives one row with exactly its
+    // column mask, so arbitrary frames are shown without ghost activations.
+    // Tables are double-buffered and swapped by the ISR at row 0.
+    uint32_t scanTables[2][NUM_ROWS][MAX_GPIO_PORTS];
+    uint32_t scanBlankBsrr[MAX_GPIO_PORTS];
+    TIM_HandleTypeDef* scanTimer;
+    volatile bool scanActive;
+    volatile bool scanSwapPending;
+    volatile uint8_t scanActiveTable;
+    volatile uint8_t scanRow;
+    uint8_t scanDutyPercent;
+    uint32_t scanRowTicks;
+    
+    // Current state of electrodes (bit set = high, clear = low)
+    ElectrodeFrame_t electrodeState;
+    
+    // Back buffer: stage*() edits collect here until commit()
+    ElectrodeFrame_t stagedState;
     
     // Sequence control variables
     volatile bool sequenceRunning;
     volatile uint16_t currentStep;
-    volatile uint32_t stepStartTime;
+    volatile uint32_t currentCycle;
+    volatile uint32_t sequenceStartTime; // HAL_GetTick() at run start (tick engine)
+    volatile uint64_t stepEnd_us;        // Current step end, from run start (tick engine)
+    volatile uint32_t stepDuration_us;
     ElectrodeSequence_t* currentSequence;
     
-    // Electrode number to row/col mapping (loaded from JSON files at runtime)
+    // Hardware-timed engine: CCR1 deadlines on a free-running 1 MHz timer
+    TIM_HandleTypeDef* sequenceTimer;
+    volatile uint32_t stepDeadline;      // Timer count at the end of the current step
+    
+    // Pause and preemption
+    volatile bool sequencePaused;
+    uint32_t pausedRemaining_us;         // Time left in the paused step
+    ElectrodeFrame_t pausedFrame;        // Outputs when paused
+    uint8_t sequencePriority;
+    
+    // A run interrupted by preemptSequence()
     typedef struct {
-        uint8_t row;
-        uint8_t col;
-    } ElectrodeMapping_t;
-    ElectrodeMapping_t electrodeMap[NUM_ELECTRODES];
+        ElectrodeSequence_t* sequence;
+        uint16_t step;
+        uint32_t cycle;
+        uint32_t stepDuration_us;
+        uint32_t remaining_us;
+        ElectrodeFrame_t frame;
+        TIM_HandleTypeDef* timer;
+        uint8_t priority;
+        bool paused;                     // Was paused by the user before
+    } SequenceContext_t;
+    SequenceContext_t preempted[SEQUENCE_PREEMPT_DEPTH];
+    volatile uint8_t preemptDepth;
     
-    // PCIE pin to row/col mapping
-    uint8_t pcieToRow[NUM_ELECTRODES];
-    uint8_t pcieToCol[NUM_ELECTRODES];
+    // Edge lateness statistics (all engines, microseconds)
+    volatile uint32_t edgeCount;
+    volatile uint32_t edgeLatencyMax;
+    volatile uint32_t edgeLatencyLast;
+    volatile uint64_t edgeLatencySum;
+    
+    void beginSequence(const ElectrodeSequence_t* sequence, TIM_HandleTypeDef* htim);
+    void applySequenceStep();
+    bool advanceSequenceStep();
+    void endSequence();
+    bool scheduleNextStep();
+    uint32_t stepRemainingMicros();
+    void resetSequenceTiming();
+    void recordStepEdge(uint32_t late_us);
+    
+    // Mapping tables in use: one of 'mappingTables' (built from JSON or
+    // copied from a compiled image), or a compiled image used in place. The
+    // other RAM table is the shadow that loads and reloads are built in.
+    MappingImage_t mappingTables[2];
+    const MappingImage_t* volatile mapping;
+    volatile MappingSource_t mappingSource;
+    
+    // Reloaded tables waiting for the next step edge
+    const MappingImage_t* volatile pendingMapping;
+    MappingReload_t lastReload;
+    
+    // Check of the mapping in use
+    MappingReport_t mappingReport;
     
     // JSON file paths
     static constexpr const char* ELECTRODE_MAP_PATH = "resources/ElectrodeMap.json";
     static constexpr const char* PIN_MAP_PATH = "resources/PinMap.json";
     static constexpr const char* PIN_DEF_PATH = "resources/PinDef.json";
+    static constexpr const char* MAPPING_IMAGE_PATH = "resources/Mapping.bin";
+    
+    // Compiled image loading
+    MappingImage_t* shadowTables();
+    void swapMapping();
+    MappingReloadError_t buildMappingTables(MappingImage_t* tables, const char* electrodeMapPath,
+                                            const char* pinMapPath, JsonYieldFn yield,
+                                            void* yieldContext, uint32_t* bytes,
+                                            MappingReport_t* report);
+    static void checkMapping(const MappingImage_t* tables, MappingReport_t* report);
+    static void serviceSequence(void* context);
+    bool loadMappingImageFile(const char* filepath);
+    bool applyImageLines(const MappingImage_t* image);
+    static void sealMappingImage(MappingImage_t* image);
     
     // JSON parsing functions
-    bool loadElectrodeMap(const char* filepath);
-    bool loadPinMap(const char* filepath);
     bool loadPinDef(const char* filepath);
-    char* readFile(const char* filepath, size_t* fileSize);
-    bool parseElectrodeMapJSON(const char* jsonData);
-    bool parsePinMapJSON(const char* jsonData);
-    bool parsePinDefJSON(const char* jsonData);
-    const char* findJSONValue(const char* json, const char* key);
+    bool parsePinDefJSON(JsonTokenizer* json);
+    bool parseElectrodeMap(JsonTokenizer* json, uint8_t* toPcie, MappingReport_t* report);
+    bool parsePinMap(JsonTokenizer* json, ElectrodeMapping_t* pcieMap, MappingReport_t* report);
+    bool parsePinDef(JsonTokenizer* json, GPIO_Pin_t* rows, GPIO_Pin_t* cols);
+    void setMacroPinLayout();
+    bool applyPinLayout(const GPIO_Pin_t* rows, const GPIO_Pin_t* cols);
+    static GPIO_TypeDef* portFromIndex(uint8_t index);
+    static uint8_t portToIndex(GPIO_TypeDef* port);
+    static bool parseRowColKey(const JsonToken_t* key, uint32_t* row, uint32_t* col);
     int parseJSONInt(const char* str);
+    bool parsePinName(const char* str, GPIO_Pin_t* line);
+    bool pinLayoutMatchesMacros();
+    inline bool fixedLayoutValid();
     
     // Helper functions for GPIO control
     inline void setRowHigh(uint8_t row);
@@ -180,8 +620,20 @@ private:
     inline void setColHigh(uint8_t col);
     inline void setColLow(uint8_t col);
     
-    // Atomic set operations for minimal delay
-    inline void setRowColAtomic(uint8_t row, uint8_t col, bool state);
+    // Per-port BSRR mask compilation for whole-pattern writes
+    void buildPortTables();
+    uint8_t getPortIndex(GPIO_TypeDef* port);
+    void compileLines(uint16_t rowActive, uint16_t colActive,
+                      uint16_t rowSelect, uint16_t colSelect,
+                      uint32_t bsrr[MAX_GPIO_PORTS]);
+    uint8_t writePortMasks(const uint32_t bsrr[MAX_GPIO_PORTS]);
+    
+    // Output path: static row/column drive or row-scan tables
+    uint8_t driveFrame();
+    void buildScanTables(uint32_t tables[NUM_ROWS][MAX_GPIO_PORTS]);
+    void loadScanTables();
+    void haltScanTimer();
+    inline void writeScanWord(const uint32_t bsrr[MAX_GPIO_PORTS]);
     
 public:
     // Constructor
@@ -194,15 +646,54 @@ public:
     void setElectrode(uint8_t row, uint8_t col, bool state);
     void setElectrodeHigh(uint8_t row, uint8_t col);
     void setElectrodeLow(uint8_t row, uint8_t col);
+    void applyStep(const ElectrodeStep_t* step);  // Electrode or frame step
     
     // Electrode control by electrode number (1-140)
     void setElectrodeByNumber(uint8_t electrodeNum, bool state);
     void setElectrodeHighByNumber(uint8_t electrodeNum);
     void setElectrodeLowByNumber(uint8_t electrodeNum);
     
-    // Convert electrode number to row/col
+    // Convert electrode number to row/col (false if the mapping leaves the
+    // electrode without a cell)
     bool getRowColFromElectrode(uint8_t electrodeNum, uint8_t* row, uint8_t* col);
     
+    // Mapping sources. The constructor takes the first that is valid: the
+    // image in flash at MAPPING_IMAGE_ADDR (if defined), resources/Mapping.bin,
+    // the JSON files, and finally a 1:1 layout. Call before init(), since the
+    // GPIO lines may change.
+    // loadMappingImage() checks magic, version, size and CRC, then copies the
+    // image into RAM, or with inPlace uses it where it is (it must stay valid,
+    // e.g. in flash). On any error the current mapping is kept.
+    bool loadMappingImage(const MappingImage_t* image, bool inPlace);
+    // Read the JSON chain; false (1:1 layout) if either map fails. Without a
+    // valid PinDef file the lines come from the header macros.
+    bool loadMappingJSON(const char* electrodeMapPath = ELECTRODE_MAP_PATH,
+                         const char* pinMapPath = PIN_MAP_PATH,
+                         const char* pinDefPath = PIN_DEF_PATH);
+    // Mapping in use as a sealed image (what tools/MappingCompiler writes)
+    void getMappingImage(MappingImage_t* image);
+    MappingSource_t getMappingSource();
+    static bool isMappingImageValid(const MappingImage_t* image);
+    
+    // Check of the mapping in use, made when it was loaded (a few thousand
+    // cycles, so it runs on every boot). Unmapped electrodes and PCIE pins
+    // stay unmapped instead of landing on cell 0,0; a mapping that is not a
+    // bijection is still used at boot, but refused by reloadMapping().
+    void getMappingReport(MappingReport_t* report);
+    
+    // Live reload after init(): ElectrodeMap.json and PinMap.json are parsed
+    // into the shadow tables and validated while the current mapping stays
+    // in use, then the tables are swapped with one pointer store - at once
+    // when no sequence runs (or it is paused), otherwise at the next step
+    // edge. Electrode states and GPIO lines are kept (PinDef.json changes
+    // need a restart); files that do not form a bijection are refused.
+    // 'yield' runs after every file chunk; by default it advances the
+    // tick-driven sequence engine, so a running sequence is never held up
+    // for more than one chunk.
+    MappingReloadError_t reloadMapping(MappingReload_t* report, JsonYieldFn yield = nullptr,
+                                       void* yieldContext = nullptr);
+    void getMappingReload(MappingReload_t* report);     // Last reload, swap progress
+    
     // Bulk operations
     void setAllElectrodesLow();
     void setAllElectrodesHigh();
@@ -213,18 +704,228 @@ public:
     bool getElectrodeState(uint8_t row, uint8_t col);
     
     // Advanced control
+    // setPattern(frame) writes only the lines whose drive level changes and
+    // returns the number of BSRR stores issued (0 while row scanning)
+    uint8_t setPattern(const ElectrodeFrame_t* frame);
+    void getPattern(ElectrodeFrame_t* frame);
     void setPattern(bool pattern[NUM_ROWS][NUM_COLS]);
     void getPattern(bool pattern[NUM_ROWS][NUM_COLS]);
     
+    // Double-buffered frame: stage*() edits only touch the back buffer,
+    // commit() applies them as one output transition. Immediate setters
+    // above write through to both buffers.
+    void stageElectrode(uint8_t row, uint8_t col, bool state);
+    void stageElectrodeByNumber(uint8_t electrodeNum, bool state);
+    void stageRowElectrodes(uint8_t row, bool state);
+    void stageColElectrodes(uint8_t col, bool state);
+    void stagePattern(const ElectrodeFrame_t* frame);
+    void getStagedPattern(ElectrodeFrame_t* frame);
+    bool hasStagedChanges();
+    void discardStaged();
+    bool commit();
+    bool isCommitPending();
+    
+    // Per-port BSRR words for a frame (static row/column drive), and the
+    // ports they belong to - used by DMA waveform playback
+    void compileFrame(const ElectrodeFrame_t* frame, uint32_t bsrr[MAX_GPIO_PORTS]);
+    uint8_t getNumGpioPorts();
+    GPIO_TypeDef* getGpioPort(uint8_t index);
+    
+    // Outputs were written outside the driver: the next write drives all lines
+    void invalidateDrivenLines();
+    
+    // True if PinDef.json assigned a layout that differs from the header macros
+    bool hasCustomPinLayout();
+    
+    // Compare 140 setElectrode() calls against one per-port mask write (DWT cycles)
+    void benchmarkPatternWrite(const ElectrodeFrame_t* frame, PatternBenchmark_t* result);
+    
+    // Compile-time electrode/line control (indices are template arguments,
+    // layout from the ROWn/COLn macros): each line change is one immediate
+    // BSRR store. Same semantics as setElectrode/setRowElectrodes/setColElectrodes.
+    template<uint8_t Row, uint8_t Col> void setElectrodeFixed(bool state);
+    template<uint8_t Row> void setRowFixed(bool state);
+    template<uint8_t Col> void setColFixed(bool state);
+    
+    // Cycles and instructions per setElectrode() vs setElectrodeFixed<>()
+    void benchmarkElectrodeWrite(ElectrodeWriteBenchmark_t* result);
+    
+    // Parse a generated map of 'entries' electrodes (entries above 140 are
+    // scanned and ignored) into a scratch table, streamed through the
+    // tokenizer's chunk buffer; the loaded mapping is not touched
+    void benchmarkMappingParse(uint16_t entries, MappingParseBenchmark_t* result);
+    
+    // Row-scan multiplexing (timer driven)
+    // refreshHz = full-frame refresh rate, dutyPercent = on-time of each row slot
+    bool startScan(TIM_HandleTypeDef* htim, uint16_t refreshHz, uint8_t dutyPercent);
+    void stopScan();
+    bool isScanning();
+    uint32_t getScanRowTicks();
+    
+    // Call from HAL_TIM_PeriodElapsedCallback / HAL_TIM_OC_DelayElapsedCallback
+    void scanTimerPeriodISR();
+    void scanTimerCompareISR();
+    
     // Sequence execution functions
+    // Blocking: waits for each step's absolute deadline from run start
     void executeSequence(const ElectrodeSequence_t* sequence);
-    void executeSequenceAsync(const ElectrodeSequence_t* sequence);
+    // Asynchronous: executeSequenceAsync() applies the first step, then
+    // updateSequence() advances steps/cycles from HAL_GetTick(). Call it from
+    // the main loop (or a periodic timer callback) at least once per ms.
+    bool executeSequenceAsync(const ElectrodeSequence_t* sequence);
+    void updateSequence();
+    
+    // Hardware-timed: steps are applied from sequenceTimerISR() at CCR1
+    // compare matches (microsecond resolution, no HAL_Delay/tick rounding)
+    bool executeSequenceTimed(TIM_HandleTypeDef* htim, const ElectrodeSequence_t* sequence);
+    void sequenceTimerISR();  // Call from HAL_TIM_OC_DelayElapsedCallback
+    void getSequenceTiming(SequenceTiming_t* timing);  // Any engine, last run
+    void getSequenceProgress(SequenceProgress_t* progress);
     bool isSequenceRunning();
     void stopSequence();
     
+    // Pause/resume (any engine): the current step keeps the time it had
+    // left, and later steps run on the usual schedule after the resume
+    bool pauseSequence();
+    bool resumeSequence();
+    bool isSequencePaused();
+    
+    // Run an urgent sequence in place of the current one (e.g. a droplet
+    // rescue during PCR). Needs a higher priority than the running sequence
+    // (plain executeSequence*() runs have priority 0); the interrupted run
+    // resumes at the same point when the urgent one ends. Starts normally
+    // if nothing runs.
+    bool preemptSequence(const ElectrodeSequence_t* sequence, uint8_t priority);
+    // True while the sequence runs or waits to resume; it must not be
+    // modified until then
+    bool isSequenceInUse(const ElectrodeSequence_t* sequence);
+    
     // Test scenarios - user provides custom electrode lists
     void runElectrodeSequenceTest(uint8_t* electrodeNumbers, uint16_t numElectrodes, uint32_t duration_ms);
     void runElectrodeTest();  // Sequential test of all electrodes (1-140)
 };
 
+// ============================================================================
+// COMPILE-TIME LINE CONTROL
+// ============================================================================
+
+// Fixed-index writes use the header macros; with a different PinDef.json
+// layout they fall back to the runtime tables. Build with
+// ARRAY_STATIC_PIN_LAYOUT to drop PinDef.json support and this check.
+inline bool ArrayDriver::fixedLayoutValid() {
+#ifdef ARRAY_STATIC_PIN_LAYOUT
+    return true;
+#else
+    return pinLayoutFromMacros;
+#endif
+}
+
+// Set one electrode with compile-time row/column
+// Only the row and column of the electrode can change level; both are
+// written with constant port addresses and masks.
+template<uint8_t Row, uint8_t Col>
+inline void ArrayDriver::setElectrodeFixed(bool state) {
+    static_assert(Row < NUM_ROWS && Col < NUM_COLS, "Electrode out of range");
+    constexpr uint16_t rowBit = (uint16_t)(1U << Row);
+    constexpr uint16_t colBit = (uint16_t)(1U << Col);
+    
+    CriticalSection lock;
+    if (state) {
+        electrodeState.rows[Row] |= colBit;
+        stagedState.rows[Row] |= colBit;
+    } else {
+        electrodeState.rows[Row] &= (uint16_t)~colBit;
+        stagedState.rows[Row] &= (uint16_t)~colBit;
+    }
+    
+    if (scanActive || !drivenLinesValid || !fixedLayoutValid()) {
+        driveFrame();
+        return;
+    }
+    
+    // Row/column stay driven while another electrode still uses them
+    bool rowOn = electrodeState.rows[Row] != 0;
+    bool colOn = state || (frameActiveCols(&electrodeState) & colBit);
+    
+    if (rowOn != ((drivenRows & rowBit) != 0)) {
+        RowLine<Row>::port()->BSRR = rowOn ? (RowLine<Row>::pin << 16U) : RowLine<Row>::pin;
+        drivenRows ^= rowBit;
+    }
+    if (colOn != ((drivenCols & colBit) != 0)) {
+        ColLine<Col>::port()->BSRR = colOn ? ColLine<Col>::pin : (ColLine<Col>::pin << 16U);
+        drivenCols ^= colBit;
+    }
+}
+
+// Set all electrodes in a compile-time row
+// The row line is one immediate store; columns whose level changes are
+// written through the per-port delta words.
+template<uint8_t Row>
+inline void ArrayDriver::setRowFixed(bool state) {
+    static_assert(Row < NUM_ROWS, "Row out of range");
+    constexpr uint16_t rowBit = (uint16_t)(1U << Row);
+    
+    CriticalSection lock;
+    electrodeState.rows[Row] = state ? FRAME_ROW_MASK : 0;
+    stagedState.rows[Row] = electrodeState.rows[Row];
+    
+    if (scanActive || !drivenLinesValid || !fixedLayoutValid()) {
+        driveFrame();
+        return;
+    }
+    
+    uint16_t colActive = frameActiveCols(&electrodeState);
+    uint16_t colChanged = colActive ^ drivenCols;
+    uint32_t bsrr[MAX_GPIO_PORTS];
+    compileLines(0, colActive, 0, colChanged, bsrr);
+    
+    if (state != ((drivenRows & rowBit) != 0)) {
+        RowLine<Row>::port()->BSRR = state ? (RowLine<Row>::pin << 16U) : RowLine<Row>::pin;
+        drivenRows ^= rowBit;
+    }
+    if (colChanged) {
+        writePortMasks(bsrr);
+        drivenCols = colActive;
+    }
+}
+
+// Set all electrodes in a compile-time column
+// The column line is one immediate store; rows whose level changes are
+// written through the per-port delta words.
+template<uint8_t Col>
+inline void ArrayDriver::setColFixed(bool state) {
+    static_assert(Col < NUM_COLS, "Column out of range");
+    constexpr uint16_t colBit = (uint16_t)(1U << Col);
+    
+    CriticalSection lock;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        if (state) {
+            electrodeState.rows[row] |= colBit;
+            stagedState.rows[row] |= colBit;
+        } else {
+            electrodeState.rows[row] &= (uint16_t)~colBit;
+            stagedState.rows[row] &= (uint16_t)~colBit;
+        }
+    }
+    
+    if (scanActive || !drivenLinesValid || !fixedLayoutValid()) {
+        driveFrame();
+        return;
+    }
+    
+    uint16_t rowActive = frameActiveRows(&electrodeState);
+    uint16_t rowChanged = rowActive ^ drivenRows;
+    uint32_t bsrr[MAX_GPIO_PORTS];
+    compileLines(rowActive, 0, rowChanged, 0, bsrr);
+    
+    if (state != ((drivenCols & colBit) != 0)) {
+        ColLine<Col>::port()->BSRR = state ? ColLine<Col>::pin : (ColLine<Col>::pin << 16U);
+        drivenCols ^= colBit;
+    }
+    if (rowChanged) {
+        writePortMasks(bsrr);
+        drivenRows = rowActive;
+    }
+}
+
 #endif // ARRAYDRIVER_H
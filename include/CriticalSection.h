@@ -0,0 +1,85 @@
+#ifndef CRITICALSECTION_H
+#define CRITICALSECTION_H
+
+#if defined(__has_include)
+#  if __has_include("stm32f4xx_hal.h")
+#    include "stm32f4xx_hal.h"
+#  else
+#    include <stdint.h>
+// Minimal fallback so this file can be linted without HAL/CMSIS present.
+static inline uint32_t __get_BASEPRI(void) { return 0; }
+static inline void __set_BASEPRI(uint32_t value) { (void)value; }
+static inline void __set_BASEPRI_MAX(uint32_t value) { (void)value; }
+#  endif
+#else
+#  include "stm32f4xx_hal.h"
+#endif
+
+#include <stdint.h>
+
+// Nestable critical section based on BASEPRI
+// Only interrupts with a priority value >= the mask priority are held off;
+// higher-priority interrupts (e.g. the UART RX interrupt feeding
+// UartCommandHandler::processByte) keep running. Each section saves the
+// BASEPRI it found and only ever raises it, so sections nest and can be
+// entered from already-masked contexts.
+//
+// Interrupt priorities:
+//   UART RX                  < CRITICAL_SECTION_MASK_PRIORITY (not masked)
+//   Row-scan / DMA timers    >= CRITICAL_SECTION_MASK_PRIORITY (masked)
+
+#ifndef CRITICAL_SECTION_MASK_PRIORITY
+#define CRITICAL_SECTION_MASK_PRIORITY 2U  // NVIC preemption priority (1-15)
+#endif
+
+#ifndef __NVIC_PRIO_BITS
+#define __NVIC_PRIO_BITS 4U
+#endif
+
+// Enable the DWT cycle counter (Cortex-M4); no-op without CMSIS
+static inline void cycleCounterStart() {
+#ifdef DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+// Read the DWT cycle counter
+static inline uint32_t cycleCounterRead() {
+#ifdef DWT
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
+
+class CriticalSection {
+private:
+    uint32_t savedBasepri;
+    
+    // Mask register value (priority shifted into the implemented bits)
+    static uint32_t maskBasepri;
+    
+    // Instrumentation (outermost sections only, DWT cycles)
+    static volatile uint8_t depth;
+    static volatile uint32_t enterCycles;
+    static volatile uint32_t longestCycles;
+    static volatile uint32_t sectionCount;
+    
+public:
+    // Enter on construction, leave on destruction
+    CriticalSection();
+    ~CriticalSection();
+    
+    // Priority at and below which interrupts are masked (1-15; 0 cannot be
+    // masked by BASEPRI and is rejected)
+    static bool setMaskPriority(uint8_t priority);
+    static uint8_t getMaskPriority();
+    
+    // Longest masked interval and number of sections since the last reset
+    static uint32_t getLongestCycles();
+    static uint32_t getSectionCount();
+    static void resetStats();
+};
+
+#endif // CRITICALSECTION_H
@@ -0,0 +1,121 @@
+#ifndef JSONTOKENIZER_H
+#define JSONTOKENIZER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Pull tokenizer for the JSON mapping files
+// One forward pass over the text: every byte is looked at once and next()
+// returns the document as a flat stream of tokens, so parsers fill their
+// tables as the keys go by instead of searching the text for each entry.
+// Input is either a NUL-terminated string in memory, a file, or a read
+// callback; files and callbacks are streamed through a JSON_CHUNK_SIZE
+// buffer inside the tokenizer, so a document never has to be in memory as
+// a whole and loading needs no heap. Key and value text is copied into the
+// tokenizer (unescaped, cut at JSON_TOKEN_LEN - 1 characters).
+
+#define JSON_CHUNK_SIZE 256
+#define JSON_TOKEN_LEN 48               // Including the terminator
+#define JSON_MAX_DEPTH 32
+
+typedef enum {
+    JSON_OBJECT_START,
+    JSON_OBJECT_END,
+    JSON_ARRAY_START,
+    JSON_ARRAY_END,
+    JSON_KEY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_LITERAL            // true, false, null
+} JsonTokenType_t;
+
+typedef enum {
+    JSON_TOKEN = 0,         // *token is valid
+    JSON_END,               // Document complete
+    JSON_ERROR              // Syntax error or nesting too deep
+} JsonStatus_t;
+
+typedef struct {
+    JsonTokenType_t type;
+    uint8_t depth;          // Containers open around the token (0: top level)
+    const char* text;       // Key, string, number or literal; valid until next()
+    uint16_t length;
+    bool truncated;         // Text longer than JSON_TOKEN_LEN - 1
+} JsonToken_t;
+
+// Fill 'buffer' with up to 'size' bytes; 0 at the end of the input
+typedef size_t (*JsonReadFn)(char* buffer, size_t size, void* context);
+
+// Called after every chunk read from a file (e.g. to keep a main-loop
+// sequence engine running during a long load)
+typedef void (*JsonYieldFn)(void* context);
+
+class JsonTokenizer {
+private:
+    typedef enum {
+        EXPECT_VALUE,
+        EXPECT_VALUE_OR_END,    // After '['
+        EXPECT_KEY,
+        EXPECT_KEY_OR_END,      // After '{'
+        EXPECT_COLON,
+        EXPECT_COMMA_OR_END,
+        EXPECT_NOTHING,         // Top-level value complete
+        FAILED
+    } State_t;
+    
+    // Input
+    const char* input;
+    size_t inputLength;
+    size_t inputPos;
+    JsonReadFn read;
+    void* readContext;
+    FILE* file;             // Opened by open()
+    JsonYieldFn yield;
+    void* yieldContext;
+    char chunk[JSON_CHUNK_SIZE];
+    uint32_t consumed;
+    int pending;            // Character read ahead by a number/literal, or -1
+    
+    State_t state;
+    uint8_t depth;
+    uint32_t objectLevels;  // Bit n set: container n is an object
+    char text[JSON_TOKEN_LEN];
+    uint16_t textLength;
+    bool truncated;
+    
+    void reset();
+    int nextChar();
+    void appendText(char c);
+    bool readString();
+    bool readBareValue(int first, JsonTokenType_t* type);
+    JsonStatus_t fail();
+    static size_t readFile(char* buffer, size_t size, void* context);
+    
+public:
+    // Constructor
+    JsonTokenizer();
+    
+    // Tokenize a NUL-terminated string (not copied; must stay valid)
+    void begin(const char* json);
+    
+    // Tokenize whatever 'read' returns, JSON_CHUNK_SIZE bytes at a time
+    void begin(JsonReadFn read, void* context);
+    
+    // Tokenize a file, a chunk at a time (the stream is unbuffered, so the
+    // C library allocates no buffer for it); close() when done
+    bool open(const char* filepath, JsonYieldFn yield = nullptr, void* yieldContext = nullptr);
+    void close();
+    
+    // Next token of the document
+    JsonStatus_t next(JsonToken_t* token);
+    
+    // Bytes consumed so far (the error position after JSON_ERROR)
+    uint32_t getPosition();
+    
+    // Whole token text as a decimal number (keys included)
+    static bool toUnsigned(const JsonToken_t* token, uint32_t* value);
+};
+
+#endif // JSONTOKENIZER_H
@@ -0,0 +1,78 @@
+#ifndef SCENARIOREGISTRY_H
+#define SCENARIOREGISTRY_H
+
+#include "ArrayDriver.h"
+
+// Named test scenarios from TestScenarios.json
+// The file is streamed through JsonTokenizer once (normally at startup)
+// and every scenario is compiled into a frame-step ElectrodeSequence_t, so
+// running one by name costs a lookup and nothing else.
+//
+// Step semantics (one frame per step, resolved at load time):
+//   "state": "high"   the step shows exactly its electrodes
+//   "state": "low"    its electrodes are cleared from the previous step's
+//                     frame (all off before the first step)
+// Durations come from "duration_ms" plus an optional "duration_us".
+// Unknown keys ("phase", "comment", ...) are ignored. A scenario with an
+// invalid electrode, no steps, or more steps than the pool has left is
+// skipped and counted in getSkipped().
+
+#define SCENARIO_MAX 8
+#define SCENARIO_MAX_STEPS 64           // Steps of all scenarios together
+#define SCENARIO_NAME_LEN 32            // Including the terminator
+
+typedef struct {
+    char name[SCENARIO_NAME_LEN];
+    ElectrodeSequence_t sequence;
+} Scenario_t;
+
+class ScenarioRegistry {
+private:
+    ArrayDriver* arrayDriver;
+    
+    Scenario_t scenarios[SCENARIO_MAX];
+    uint8_t numScenarios;
+    uint8_t skipped;
+    
+    // Compiled steps of all scenarios
+    ElectrodeStep_t steps[SCENARIO_MAX_STEPS];
+    ElectrodeFrame_t frames[SCENARIO_MAX_STEPS];
+    uint16_t stepsUsed;
+    
+    static constexpr const char* SCENARIOS_PATH = "resources/TestScenarios.json";
+    
+    // Members of the step object being read
+    typedef struct {
+        ElectrodeFrame_t electrodes;
+        bool high;
+        bool valid;
+        uint32_t ms;
+        uint32_t us;
+    } StepFields_t;
+    
+    uint8_t parse(JsonTokenizer* json);
+    bool addStep(const StepFields_t* step, ElectrodeFrame_t* frame, uint16_t index);
+    bool registerScenario(Scenario_t* scenario, bool valid, uint16_t numSteps);
+    
+public:
+    // Constructor
+    ScenarioRegistry(ArrayDriver* driver);
+    
+    // Read and compile a scenario file (the electrode mapping must already
+    // be loaded). Replaces all registered scenarios; returns how many were
+    // registered.
+    uint8_t load(const char* filepath = SCENARIOS_PATH);
+    
+    // Same from JSON text already in memory
+    uint8_t loadJSON(const char* json);
+    
+    // Compiled sequence of a scenario (nullptr if unknown); the sequence
+    // stays valid until the next load()
+    const ElectrodeSequence_t* find(const char* name);
+    
+    uint8_t getCount();
+    uint8_t getSkipped();                 // Invalid scenarios in the last load
+    const Scenario_t* getScenario(uint8_t index);
+};
+
+#endif // SCENARIOREGISTRY_H
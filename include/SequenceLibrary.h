@@ -0,0 +1,146 @@
+#ifndef SEQUENCELIBRARY_H
+#define SEQUENCELIBRARY_H
+
+#include "ArrayDriver.h"
+
+// Sequence library in internal flash
+// Compiled sequences (one frame + duration per step) are stored under a
+// numeric id and a short name, and loaded back without any parsing: the
+// loaded steps point straight at the frames in flash.
+//
+// Two flash sectors are used in turn. The active sector holds a log of
+// records; a record is valid once its 'committed' word has been
+// programmed to 0, after the payload and CRC are in place. Replacing a
+// sequence appends the new record, commits it, and only then marks the old
+// one deleted, so a reset at any point leaves either the old or the new
+// version. When the log is full, live records are copied to the other
+// sector, whose header (with a higher generation) is written last; the old
+// sector is erased afterwards.
+//
+// The sectors must be excluded from the firmware image in the linker
+// script. Sector erase stalls code fetch from flash for up to ~2 s, so only
+// store or delete while no sequence runs.
+
+#ifndef SEQLIB_SECTOR_A
+#define SEQLIB_SECTOR_A FLASH_SECTOR_10
+#define SEQLIB_SECTOR_A_ADDR (FLASH_BASE + 0xC0000U)
+#define SEQLIB_SECTOR_B FLASH_SECTOR_11
+#define SEQLIB_SECTOR_B_ADDR (FLASH_BASE + 0xE0000U)
+#define SEQLIB_SECTOR_SIZE 0x20000U
+#endif
+
+#define SEQLIB_MAX_ENTRIES 32
+#define SEQLIB_MAX_STEPS 256
+#define SEQLIB_NAME_LEN 16              // Including the terminator
+
+#define SEQLIB_SECTOR_MAGIC 0x424C5153U  // "SQLB"
+#define SEQLIB_RECORD_MAGIC 0x43525153U  // "SQRC"
+#define SEQLIB_ERASED 0xFFFFFFFFU
+
+typedef enum {
+    LIBRARY_OK = 0,
+    LIBRARY_ERR_INVALID,      // Bad id, name or sequence
+    LIBRARY_ERR_NAME,         // Name used by another id
+    LIBRARY_ERR_ENTRIES,      // SEQLIB_MAX_ENTRIES sequences stored
+    LIBRARY_ERR_FULL,         // Not enough flash even after compaction
+    LIBRARY_ERR_FLASH,        // Program/erase failed or read-back mismatch
+    LIBRARY_ERR_NOT_FOUND
+} LibraryError_t;
+
+// Sector header (written last when a sector becomes active)
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+} LibrarySectorHeader_t;
+
+// Record header, followed by numSteps LibraryStep_t
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;           // CRC-32 from 'id' to the end of the payload
+    uint32_t committed;     // 0: record complete
+    uint32_t deleted;       // 0: replaced or deleted
+    uint16_t id;
+    uint16_t numSteps;
+    uint32_t cycleCount;
+    uint32_t cycleDelay_ms;
+    char name[SEQLIB_NAME_LEN];
+} LibraryRecord_t;
+
+typedef struct {
+    ElectrodeFrame_t frame;
+    uint32_t duration_us;
+} LibraryStep_t;
+
+typedef struct {
+    uint16_t id;
+    char name[SEQLIB_NAME_LEN];
+    uint16_t numSteps;
+    uint32_t cycleCount;
+    uint32_t cycleDelay_ms;
+    uint32_t bytes;         // Record size in flash
+} LibraryEntry_t;
+
+typedef struct {
+    uint8_t sequences;
+    uint32_t usedBytes;         // Live records
+    uint32_t reclaimableBytes;  // Replaced, deleted or incomplete records
+    uint32_t freeBytes;         // Erased space after the log
+    uint32_t totalBytes;        // Sector size minus its header
+    uint32_t generation;        // Incremented by every compaction
+} LibraryUsage_t;
+
+class SequenceLibrary {
+private:
+    typedef struct {
+        uint16_t id;
+        uint32_t offset;    // Record offset in the active sector
+    } IndexEntry_t;
+    
+    bool mounted;
+    uint8_t active;         // Sector in use (0 = A, 1 = B)
+    uint32_t generation;
+    uint32_t writeOffset;   // First free byte of the active sector
+    uint32_t reclaimable;
+    IndexEntry_t index[SEQLIB_MAX_ENTRIES];
+    uint8_t count;
+    
+    static uintptr_t sectorAddress(uint8_t sector);
+    static uint32_t recordSize(uint16_t numSteps);
+    const LibraryRecord_t* record(uint32_t offset);
+    int8_t findIndex(uint16_t id);
+    bool isErased(uintptr_t address, uint32_t length);
+    bool eraseSector(uint8_t sector);
+    bool programWords(uintptr_t address, const void* data, uint32_t length);
+    void scan();
+    bool compact();
+    
+public:
+    // Constructor
+    SequenceLibrary();
+    
+    // Find the active sector and index its records; formats the store if
+    // neither sector holds one. Returns false on a flash error.
+    bool init();
+    
+    // Save a sequence under id (1-65534) and name, replacing any sequence
+    // with that id. Steps are stored as frames: a step without a frame is
+    // applied to the previous step's frame, starting from all off.
+    LibraryError_t store(uint16_t id, const char* name, const ElectrodeSequence_t* sequence);
+    
+    // Delete a sequence
+    LibraryError_t remove(uint16_t id);
+    
+    // Build a runnable sequence into 'steps'. The step frames point into
+    // flash and stay valid until the next store() or remove(), which may
+    // move records.
+    bool load(uint16_t id, ElectrodeStep_t* steps, uint16_t maxSteps, ElectrodeSequence_t* sequence);
+    
+    // Look up a sequence id by name
+    bool findByName(const char* name, uint16_t* id);
+    
+    uint8_t getCount();
+    bool getEntry(uint8_t index, LibraryEntry_t* entry);   // Storage order
+    void getUsage(LibraryUsage_t* usage);
+};
+
+#endif // SEQUENCELIBRARY_H
@@ -0,0 +1,137 @@
+#ifndef SEQUENCEPROGRAM_H
+#define SEQUENCEPROGRAM_H
+
+#include "ArrayDriver.h"
+
+// Sequence bytecode
+// A program is a byte string of opcodes with little-endian operands. It
+// refers to a table of frames by index, so a multi-stage protocol (hot
+// start, 35 cycles of three phases, final extension) takes a few dozen
+// bytes plus one ElectrodeFrame_t per distinct electrode pattern, instead
+// of an unrolled step array.
+//
+// Electrode changes between two waits are collected and applied as one
+// frame transition (setPattern) when the next WAIT or END is reached.
+//
+//   Opcode          Operands        Effect
+//   END             -               Apply pending changes, stop
+//   FRAME           idx:u8          Pending frame = frames[idx]
+//   ON / OFF        row:u8 col:u8   Set / clear one electrode
+//   CLEAR           -               Pending frame = all off
+//   WAIT_MS         ms:u32          Apply pending changes, hold
+//   WAIT_US         us:u16          Same, microseconds (tick resolution)
+//   LOOP            count:u16       Repeat the body up to ENDLOOP count times
+//   ENDLOOP         -
+//   LABEL           id:u8           Jump target (no-op when executed)
+//   JUMP            id:u8           Continue at LABEL id
+//   CALL            id:u8           Call the subroutine at LABEL id
+//   RET             -               Return from CALL
+//
+// Waits are absolute deadlines from the program start (as in
+// ArrayDriver::updateSequence), so the run time does not drift.
+
+#define PROGRAM_MAX_DEPTH 8           // Nested LOOP/CALL levels
+#define PROGRAM_MAX_LABELS 16         // Label ids 0..15
+#define PROGRAM_MAX_OPS_PER_UPDATE 256  // Instructions per update() without a wait
+
+enum {
+    OP_END = 0x00,
+    OP_FRAME = 0x01,
+    OP_ON = 0x02,
+    OP_OFF = 0x03,
+    OP_CLEAR = 0x04,
+    OP_WAIT_MS = 0x05,
+    OP_WAIT_US = 0x06,
+    OP_LOOP = 0x07,
+    OP_ENDLOOP = 0x08,
+    OP_LABEL = 0x09,
+    OP_JUMP = 0x0A,
+    OP_CALL = 0x0B,
+    OP_RET = 0x0C
+};
+
+// Assembler macros for program tables
+#define P_END()          OP_END
+#define P_FRAME(idx)     OP_FRAME, (uint8_t)(idx)
+#define P_ON(row, col)   OP_ON, (uint8_t)(row), (uint8_t)(col)
+#define P_OFF(row, col)  OP_OFF, (uint8_t)(row), (uint8_t)(col)
+#define P_CLEAR()        OP_CLEAR
+#define P_WAIT_MS(ms)    OP_WAIT_MS, (uint8_t)(ms), (uint8_t)((ms) >> 8), (uint8_t)((ms) >> 16), (uint8_t)((ms) >> 24)
+#define P_WAIT_US(us)    OP_WAIT_US, (uint8_t)(us), (uint8_t)((us) >> 8)
+#define P_LOOP(count)    OP_LOOP, (uint8_t)(count), (uint8_t)((count) >> 8)
+#define P_ENDLOOP()      OP_ENDLOOP
+#define P_LABEL(id)      OP_LABEL, (uint8_t)(id)
+#define P_JUMP(id)       OP_JUMP, (uint8_t)(id)
+#define P_CALL(id)       OP_CALL, (uint8_t)(id)
+#define P_RET()          OP_RET
+
+typedef enum {
+    PROGRAM_OK = 0,
+    PROGRAM_ERR_OPCODE,       // Unknown opcode
+    PROGRAM_ERR_TRUNCATED,    // Operand runs past the end of the code
+    PROGRAM_ERR_FRAME,        // Frame index outside the frame table
+    PROGRAM_ERR_ELECTRODE,    // Row/column out of range
+    PROGRAM_ERR_LOOP,         // Unbalanced LOOP/ENDLOOP, zero count or too deep
+    PROGRAM_ERR_LABEL,        // Duplicate, undefined or out-of-range label
+    PROGRAM_ERR_STACK         // CALL/RET nesting error at run time
+} ProgramError_t;
+
+// LOOP/CALL stack entry
+typedef struct {
+    uint16_t returnPc;      // Loop body start, or the instruction after CALL
+    uint16_t remaining;     // Loop passes left (0 for CALL)
+    bool isCall;
+} ProgramFrame_t;
+
+class SequenceProgram {
+private:
+    ArrayDriver* arrayDriver;
+    
+    // Loaded program
+    const uint8_t* code;
+    uint16_t codeLength;
+    const ElectrodeFrame_t* frames;
+    uint8_t numFrames;
+    uint16_t labels[PROGRAM_MAX_LABELS];
+    
+    // Interpreter state
+    volatile bool running;
+    uint16_t pc;
+    ProgramFrame_t stack[PROGRAM_MAX_DEPTH];
+    uint8_t depth;
+    ElectrodeFrame_t pending;
+    uint32_t startTime;     // HAL_GetTick() at program start
+    uint64_t wakeAt_us;     // End of the current wait, from program start
+    ProgramError_t error;
+    
+    static uint8_t operandBytes(uint8_t opcode);
+    ProgramError_t validate();
+    bool execute();
+    void fail(ProgramError_t err);
+    
+public:
+    // Constructor
+    SequenceProgram(ArrayDriver* driver);
+    
+    // Check the program and resolve its labels. The code and frame table
+    // are referenced, not copied, and must stay valid while it runs.
+    ProgramError_t load(const uint8_t* program, uint16_t length,
+                        const ElectrodeFrame_t* frameTable, uint8_t frameCount);
+    
+    // Start the loaded program from the current array state; runs up to the
+    // first wait. Returns false if nothing valid is loaded or the driver is
+    // running its own sequence.
+    bool start();
+    
+    // Advance the program (call from the main loop at least once per ms)
+    void update();
+    
+    // Stop; outputs keep the last applied frame
+    void stop();
+    
+    bool isRunning();
+    ProgramError_t getError();   // Load or run-time error of the last program
+    uint16_t getPc();
+};
+
+#endif // SEQUENCEPROGRAM_H
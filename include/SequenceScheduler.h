@@ -0,0 +1,101 @@
+#ifndef SEQUENCESCHEDULER_H
+#define SEQUENCESCHEDULER_H
+
+#include "ArrayDriver.h"
+
+// Concurrent sequence tracks
+// Several independent ElectrodeSequence_t run side by side (e.g. transport
+// on one side of the chip, mixing on the other). Each track keeps its own
+// step/cycle position, its own deadlines (offsets from the track start, as
+// in ArrayDriver::updateSequence) and its own frame; update() ORs the track
+// frames into one output frame and writes it with a single setPattern().
+//
+// Every merge is checked for conflicts between pairs of tracks:
+//   - claim: both tracks drive the same electrode
+//   - ghost: with static drive, a row of one track and a column of the
+//     other energize an electrode neither track asked for (skipped while
+//     the driver is row-scanning, which shows frames without ghosts)
+// A conflict is reported once when it appears; it is reported again only
+// after it has cleared.
+
+#define SCHEDULER_MAX_TRACKS 4
+#define SCHEDULER_MAX_CONFLICTS 16   // Conflict records kept (later ones are only counted)
+
+typedef enum {
+    TRACK_CONFLICT_CLAIM = 0,
+    TRACK_CONFLICT_GHOST
+} TrackConflictType_t;
+
+// One reported conflict
+typedef struct {
+    TrackConflictType_t type;
+    uint8_t trackA;
+    uint8_t trackB;
+    uint8_t row;            // First affected electrode
+    uint8_t col;
+    uint16_t electrodes;    // Number of affected electrodes
+    uint32_t time_ms;       // HAL_GetTick() when detected
+} TrackConflict_t;
+
+// State of one track
+typedef struct {
+    const ElectrodeSequence_t* sequence;  // nullptr: slot free
+    bool running;           // false once the last step has ended
+    uint32_t cycle;
+    uint16_t step;
+    uint32_t startTime;     // HAL_GetTick() at track start
+    uint64_t stepEnd_us;    // Current step end, from track start
+    ElectrodeFrame_t frame; // This track's contribution
+} SequenceTrack_t;
+
+class SequenceScheduler {
+private:
+    ArrayDriver* arrayDriver;
+    SequenceTrack_t tracks[SCHEDULER_MAX_TRACKS];
+    ElectrodeFrame_t output;
+    
+    // Conflicts currently present per track pair (bit = TrackConflictType_t)
+    uint8_t activeConflicts[SCHEDULER_MAX_TRACKS][SCHEDULER_MAX_TRACKS];
+    TrackConflict_t conflicts[SCHEDULER_MAX_CONFLICTS];
+    uint16_t numConflicts;
+    uint32_t totalConflicts;
+    
+    uint64_t stepDuration(const SequenceTrack_t* track);
+    bool advanceTrack(SequenceTrack_t* track, uint32_t now);
+    void checkConflicts();
+    void reportConflict(TrackConflictType_t type, uint8_t a, uint8_t b, const ElectrodeFrame_t* affected);
+    void merge();
+    
+public:
+    // Constructor
+    SequenceScheduler(ArrayDriver* driver);
+    
+    // Start a sequence on a free track; its first step is applied at once.
+    // Returns the track index, or -1 if all tracks are in use, the sequence
+    // is empty, or the driver is running its own sequence.
+    // The sequence (and any step frames) must stay valid until the track is
+    // removed.
+    int8_t addTrack(const ElectrodeSequence_t* sequence);
+    
+    // Release a track; its electrodes are dropped from the output
+    void removeTrack(uint8_t track);
+    
+    // Advance all tracks and write the merged frame if it changed.
+    // Call from the main loop at least once per ms.
+    void update();
+    
+    // Stop and release all tracks; outputs keep the last written state
+    void stop();
+    
+    bool isTrackRunning(uint8_t track);
+    uint8_t getRunningTracks();          // Number of tracks still stepping
+    void getOutput(ElectrodeFrame_t* frame);
+    
+    // Conflict report
+    uint32_t getConflictCount();         // All conflicts detected
+    uint16_t getStoredConflicts();       // Records available (first SCHEDULER_MAX_CONFLICTS)
+    bool getConflict(uint16_t index, TrackConflict_t* conflict);
+    void clearConflicts();
+};
+
+#endif // SEQUENCESCHEDULER_H
@@ -0,0 +1,80 @@
+#ifndef SEQUENCESTREAM_H
+#define SEQUENCESTREAM_H
+
+#include "ArrayDriver.h"
+
+// Streamed sequence playback
+// Steps (target frame + duration) are pushed into a ring buffer while
+// earlier steps play, so a sequence of any length runs without being held
+// in RAM as a whole. The producer (UART parser) and the consumer (update())
+// only share the free-running head/tail indices.
+//
+// Flow control: the producer may push at most getFree() steps; the UART
+// handler reports the free space after every chunk and when the buffer
+// runs low. If the buffer runs dry anyway, the last step is held, the
+// underrun is counted, and the schedule restarts from the next step that
+// arrives (that step still gets its full duration).
+
+#define STREAM_RING_STEPS 64         // Power of two
+#define STREAM_LOW_WATER 16          // Ask for more data below this level
+
+typedef struct {
+    ElectrodeFrame_t frame;
+    uint32_t duration_us;
+} StreamStep_t;
+
+typedef struct {
+    bool active;            // Between begin() and the last step / abort()
+    bool inputEnded;        // end() called: no more steps will be pushed
+    uint16_t buffered;
+    uint16_t free;
+    uint32_t stepsPlayed;
+    uint32_t underruns;
+    uint32_t underrunTime_ms;   // Total time spent waiting for data
+} StreamStatus_t;
+
+class SequenceStream {
+private:
+    ArrayDriver* arrayDriver;
+    StreamStep_t ring[STREAM_RING_STEPS];
+    volatile uint16_t head;     // Next slot to write (producer)
+    volatile uint16_t tail;     // Next slot to play (consumer)
+    
+    volatile bool active;
+    volatile bool inputEnded;
+    bool playing;               // First step applied
+    bool starved;               // Waiting for data
+    uint32_t startTime;         // HAL_GetTick() the schedule is measured from
+    uint64_t stepEnd_us;        // Current step end, from startTime
+    uint32_t starvedSince;
+    uint32_t stepsPlayed;
+    uint32_t underruns;
+    uint32_t underrunTime_ms;
+    
+public:
+    // Constructor
+    SequenceStream(ArrayDriver* driver);
+    
+    // Start an empty stream; playback begins with the first pushed step.
+    // Returns false if a stream is active or the driver runs a sequence.
+    bool begin();
+    
+    // Append one step (false if the ring is full or no stream is open)
+    bool push(const ElectrodeFrame_t* frame, uint32_t duration_us);
+    
+    // No more steps will be pushed; the stream ends after the last one
+    void end();
+    
+    // Stop at once; outputs keep the last applied frame
+    void abort();
+    
+    // Apply every step whose start time has passed (call at least once per ms)
+    void update();
+    
+    bool isActive();
+    uint16_t getBuffered();
+    uint16_t getFree();
+    void getStatus(StreamStatus_t* status);
+};
+
+#endif // SEQUENCESTREAM_H
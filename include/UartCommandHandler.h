@@ -3,6 +3,9 @@
 
 #include "stm32f4xx_hal.h"
 #include "ArrayDriver.h"
+#include "SequenceStream.h"
+#include "SequenceLibrary.h"
+#include "ScenarioRegistry.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -11,6 +14,7 @@
 // Command buffer size
 #define UART_CMD_BUFFER_SIZE 2048
 #define MAX_STEPS 256
+#define PREEMPT_MAX_STEPS 32            // Steps of a PREEMPT sequence from the library
 #define UART_RESPONSE_BUFFER_SIZE 256
 
 class UartCommandHandler {
@@ -28,11 +32,45 @@ private:
     
     // Sequence storage
     ElectrodeStep_t sequenceSteps[MAX_STEPS];
+    ElectrodeFrame_t stepFrames[MAX_STEPS];  // Electrode set of each step
     ElectrodeSequence_t currentSequence;
+    bool sequenceStarted;  // START issued, completion not yet reported
+    TIM_HandleTypeDef* sequenceTimer;  // Step timer for START (nullptr: tick engine)
+    
+    // Streamed sequence (STREAM|...)
+    SequenceStream sequenceStream;
+    bool streamLowReported;  // STREAM|LOW sent since the last chunk
+    bool streamEnded;        // STREAM|END received, completion not yet reported
+    
+    // Stored sequences (STORE/RUN/LIB/DELETE)
+    SequenceLibrary sequenceLibrary;
+    
+    // Scenarios from TestScenarios.json (RUN|NAME)
+    ScenarioRegistry scenarios;
+    
+    // PREEMPT sequences: the running one plus every interrupted one may be a
+    // PREEMPT run, and a new one is loaded into a slot none of them uses
+    ElectrodeStep_t urgentSteps[SEQUENCE_PREEMPT_DEPTH + 1][PREEMPT_MAX_STEPS];
+    ElectrodeSequence_t urgentSequence[SEQUENCE_PREEMPT_DEPTH + 1];
+    uint8_t preemptedRuns;  // Interrupted runs at the last update()
+    
+    // RELOAD: swap waiting for a step edge, scenarios still on the old mapping
+    bool mappingSwapPending;
+    bool scenariosStale;
     
     // Command parsing functions
     void parseCommand(char* cmd);
     void parseElectrodeCommand(char* cmd);
+    void parseStreamCommand(char* cmd);
+    bool parseStep(char** cursor, int index, ElectrodeFrame_t* frame, uint32_t* duration_us);
+    bool parseSequence(char* ptr);
+    void parseStoreCommand(char* cmd);
+    void parseRunCommand(char* cmd);
+    void parseLibraryCommand(char* cmd);
+    void parseDeleteCommand(char* cmd);
+    void parsePauseCommand(char* cmd);
+    void parseResumeCommand(char* cmd);
+    void parsePreemptCommand(char* cmd);
     void parseSingleElectrodeCommand(char* cmd);
     void parseAllElectrodesCommand(char* cmd);
     void parseRowCommand(char* cmd);
@@ -42,16 +80,31 @@ private:
     void parseStopCommand(char* cmd);
     void parseGetStateCommand(char* cmd);
     void parseReloadMappingCommand(char* cmd);
+    void parseMapCheckCommand(char* cmd);
+    void parseBenchCommand(char* cmd);
+    void parseFrameCommand(char* cmd);
+    void parseStageCommand(char* cmd);
+    void parseCommitCommand(char* cmd);
+    void parseDiscardCommand(char* cmd);
     
     // Helper functions
     void sendResponse(const char* response);
     void sendError(const char* errorMsg);
     void sendOK();
+    void sendMappingReport(const MappingReport_t* report);
+    void sendMappingProblem(uint16_t count, const char* what, uint8_t first, bool cell);
+    
+    // Start currentSequence (parsed by START or loaded by RUN)
+    void startSequence();
+    
+    // Keep main-loop playback going while RELOAD reads the mapping files
+    static void serviceDuringReload(void* context);
+    
+    // Look up a library id, library name or scenario name (RUN/PREEMPT);
+    // *id is 0 for a scenario
+    bool loadSequence(const char* ref, ElectrodeStep_t* steps, uint16_t maxSteps,
+                      ElectrodeSequence_t* sequence, uint16_t* id);
     
-    // Execute sequence from parsed data
-    void executeSequence(int cycleReps, int cycleDelay, int numSteps, 
-                        int* electrodeIds, int* durations);
-
 public:
     // Constructor
     UartCommandHandler(ArrayDriver* driver, UART_HandleTypeDef* uart);
@@ -59,12 +112,20 @@ public:
     // Initialization
     void init();
     
+    // Run START sequences from a 32-bit compare timer (microsecond steps);
+    // route its compare callback to ArrayDriver::sequenceTimerISR()
+    void setSequenceTimer(TIM_HandleTypeDef* htim);
+    
     // Process incoming byte (call from UART interrupt or polling)
     void processByte(uint8_t byte);
     
     // Process complete command (call from main loop)
     void processCommands();
     
+    // Advance the running sequence and report its completion
+    // (call from main loop on every pass)
+    void update();
+    
     // Check if command is ready
     bool isCommandReady();
 };
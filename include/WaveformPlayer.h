@@ -0,0 +1,95 @@
+#ifndef WAVEFORMPLAYER_H
+#define WAVEFORMPLAYER_H
+
+#include "ArrayDriver.h"
+
+// DMA waveform playback
+// An ElectrodeSequence_t is compiled into samples of one BSRR word per GPIO
+// port plus a hold time. A timer (TIM1/TIM8 - only DMA2 reaches the AHB1
+// GPIO ports) plays them without CPU involvement:
+//   - CCx DMA request (CCRx = 0, i.e. every update) writes port x's BSRR word
+//   - Update DMA request writes the next hold time into the preloaded ARR
+// Both streams run circular over a double buffer; the half/complete
+// interrupts refill the half that just played from the sequence, so
+// protocols of any length stream through a fixed buffer.
+
+#define WAVEFORM_TIMER_CLOCK_HZ 1000000U   // Timer counter clock (1 us ticks)
+#define WAVEFORM_MAX_SAMPLE_TICKS 65536U   // 16-bit ARR; longer holds are split
+#define WAVEFORM_BUFFER_SAMPLES 64         // Both halves of the double buffer
+#define WAVEFORM_PAD_TICKS 100U            // Hold of the padding after the last step
+
+// Timer and DMA streams used for playback (configured by CubeMX):
+// portDma[i] memory-to-peripheral, 32-bit, circular, on the TIMx_CH(i+1)
+// request; reloadDma the same on the TIMx_UP request.
+typedef struct {
+    TIM_HandleTypeDef* htim;
+    DMA_HandleTypeDef* portDma[MAX_GPIO_PORTS];
+    DMA_HandleTypeDef* reloadDma;
+} WaveformHardware_t;
+
+// One compiled sample: output words and how long they are held
+typedef struct {
+    uint32_t bsrr[MAX_GPIO_PORTS];
+    uint32_t ticks;
+} WaveformSample_t;
+
+class WaveformPlayer {
+private:
+    ArrayDriver* arrayDriver;
+    WaveformHardware_t hw;
+    
+    // DMA double buffers (one stream per port + ARR reload stream)
+    uint32_t portBuffer[MAX_GPIO_PORTS][WAVEFORM_BUFFER_SAMPLES];
+    uint32_t reloadBuffer[WAVEFORM_BUFFER_SAMPLES];
+    
+    // Sequence compiler cursor
+    const ElectrodeSequence_t* sequence;
+    uint32_t cycle;
+    uint16_t step;
+    ElectrodeFrame_t frame;
+    uint32_t frameWords[MAX_GPIO_PORTS];
+    uint64_t holdTicks;
+    bool compileDone;
+    
+    // Sample whose port words go into the next buffer slot
+    WaveformSample_t lookahead;
+    
+    // Playback progress (in buffer slots = update events)
+    volatile bool playing;
+    volatile bool handBackPending;  // Final frame waits for update()
+    uint32_t slotsFilled;
+    uint32_t slotsPlayed;
+    uint32_t endSlot;
+    
+    static WaveformPlayer* activePlayer;
+    
+    bool nextSample(WaveformSample_t* sample);
+    void fillSlots(uint16_t first, uint16_t count);
+    void finish();
+    
+    static void dmaHalfCompleteCallback(DMA_HandleTypeDef* hdma);
+    static void dmaCompleteCallback(DMA_HandleTypeDef* hdma);
+    
+public:
+    // Constructor
+    WaveformPlayer(ArrayDriver* driver);
+    
+    // Compile the start of the sequence, prime the buffers and start the timer.
+    // Returns false if the hardware is incomplete, the driver is row-scanning
+    // or running a sequence, a playback is active, or the sequence has no
+    // timed steps.
+    bool start(const WaveformHardware_t* hardware, const ElectrodeSequence_t* seq);
+    
+    // Stop playback; outputs keep the last written state
+    void stop();
+    
+    // Hand the final frame of a finished playback to the driver (call from
+    // the main loop; the DMA interrupt only stops the hardware)
+    void update();
+    
+    // True until update() has handed the final frame back
+    bool isPlaying();
+    uint32_t getSamplesPlayed();
+};
+
+#endif // WAVEFORMPLAYER_H
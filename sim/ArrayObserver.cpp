@@ -0,0 +1,168 @@
+#include "ArrayObserver.h"
+
+// Constructor
+ArrayObserver::ArrayObserver() {
+    // Same layout as the driver's header pin macros
+    rowPins[0] = {ROW0_PORT, ROW0_PIN};
+    rowPins[1] = {ROW1_PORT, ROW1_PIN};
+    rowPins[2] = {ROW2_PORT, ROW2_PIN};
+    rowPins[3] = {ROW3_PORT, ROW3_PIN};
+    rowPins[4] = {ROW4_PORT, ROW4_PIN};
+    rowPins[5] = {ROW5_PORT, ROW5_PIN};
+    rowPins[6] = {ROW6_PORT, ROW6_PIN};
+    rowPins[7] = {ROW7_PORT, ROW7_PIN};
+    rowPins[8] = {ROW8_PORT, ROW8_PIN};
+    rowPins[9] = {ROW9_PORT, ROW9_PIN};
+    
+    colPins[0] = {COL0_PORT, COL0_PIN};
+    colPins[1] = {COL1_PORT, COL1_PIN};
+    colPins[2] = {COL2_PORT, COL2_PIN};
+    colPins[3] = {COL3_PORT, COL3_PIN};
+    colPins[4] = {COL4_PORT, COL4_PIN};
+    colPins[5] = {COL5_PORT, COL5_PIN};
+    colPins[6] = {COL6_PORT, COL6_PIN};
+    colPins[7] = {COL7_PORT, COL7_PIN};
+    colPins[8] = {COL8_PORT, COL8_PIN};
+    colPins[9] = {COL9_PORT, COL9_PIN};
+    colPins[10] = {COL10_PORT, COL10_PIN};
+    colPins[11] = {COL11_PORT, COL11_PIN};
+    colPins[12] = {COL12_PORT, COL12_PIN};
+    colPins[13] = {COL13_PORT, COL13_PIN};
+    
+    frameClear(&expected);
+    frameClear(&energized);
+    drivenRows = 0;
+    markerRow = 0;
+    memset(&report, 0, sizeof(report));
+    memset(onTime_us, 0, sizeof(onTime_us));
+}
+
+// Start observing GPIO changes
+void ArrayObserver::attach(const ElectrodeFrame_t* expectedFrame) {
+    if (expectedFrame) {
+        expected = *expectedFrame;
+    } else {
+        frameClear(&expected);
+    }
+    
+    memset(&report, 0, sizeof(report));
+    memset(onTime_us, 0, sizeof(onTime_us));
+    report.minRefreshPeriod_us = UINT64_MAX;
+    
+    // Refresh timing is measured on the first row that has electrodes
+    markerRow = 0;
+    while (markerRow < NUM_ROWS - 1 && expected.rows[markerRow] == 0) {
+        markerRow++;
+    }
+    
+    start_us = HostSim_Micros();
+    lastChange_us = start_us;
+    lastRefresh_us = 0;
+    
+    // Decode the state the pins are already in
+    drivenRows = 0;
+    frameClear(&energized);
+    HostSim_SetGpioHook(gpioHook, this);
+    sample();
+    report.gpioChanges = 0;
+}
+
+// Stop observing
+void ArrayObserver::detach() {
+    finish();
+    HostSim_SetGpioHook(nullptr, nullptr);
+}
+
+// Close the current interval
+void ArrayObserver::finish() {
+    accumulate(HostSim_Micros());
+}
+
+// GPIO hook trampoline
+void ArrayObserver::gpioHook(GPIO_TypeDef* port, void* context) {
+    (void)port;
+    static_cast<ArrayObserver*>(context)->sample();
+}
+
+// Integrate on-time of the previous state up to 'now'
+void ArrayObserver::accumulate(uint64_t now) {
+    uint64_t elapsed = now - lastChange_us;
+    if (elapsed == 0) {
+        return;
+    }
+    
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        uint16_t bits = energized.rows[row];
+        for (uint8_t col = 0; bits; col++, bits >>= 1) {
+            if (bits & 1U) {
+                onTime_us[row][col] += elapsed;
+            }
+        }
+    }
+    
+    report.observed_us += elapsed;
+    lastChange_us = now;
+}
+
+// Decode pin levels after an output change
+void ArrayObserver::sample() {
+    uint64_t now = HostSim_Micros();
+    accumulate(now);
+    
+    uint16_t rows = 0;
+    uint16_t cols = 0;
+    
+    // Row driven = LOW, column driven = HIGH
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        if (!(rowPins[row].port->ODR & rowPins[row].pin)) {
+            rows |= (uint16_t)(1U << row);
+        }
+    }
+    for (uint8_t col = 0; col < NUM_COLS; col++) {
+        if (colPins[col].port->ODR & colPins[col].pin) {
+            cols |= (uint16_t)(1U << col);
+        }
+    }
+    
+    // Marker row becoming driven marks a new refresh frame
+    uint16_t marker = (uint16_t)(1U << markerRow);
+    if ((rows & marker) && !(drivenRows & marker)) {
+        if (report.refreshes > 0) {
+            uint64_t period = now - lastRefresh_us;
+            if (period < report.minRefreshPeriod_us) report.minRefreshPeriod_us = period;
+            if (period > report.maxRefreshPeriod_us) report.maxRefreshPeriod_us = period;
+        }
+        lastRefresh_us = now;
+        report.refreshes++;
+    }
+    drivenRows = rows;
+    
+    bool ghost = false;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        energized.rows[row] = (rows & (1U << row)) ? cols : 0;
+        report.energizedUnion.rows[row] |= energized.rows[row];
+        
+        uint16_t extra = energized.rows[row] & (uint16_t)~expected.rows[row];
+        if (extra) {
+            report.ghostUnion.rows[row] |= extra;
+            ghost = true;
+        }
+    }
+    
+    report.gpioChanges++;
+    if (ghost) {
+        report.ghostChanges++;
+    }
+    if (__builtin_popcount(rows) > 1 && cols) {
+        report.multiRowChanges++;
+    }
+}
+
+// Current decoded state
+void ArrayObserver::getEnergized(ElectrodeFrame_t* frame) {
+    *frame = energized;
+}
+
+uint16_t ArrayObserver::getDrivenRows() {
+    return drivenRows;
+}
@@ -0,0 +1,57 @@
+#ifndef ARRAYOBSERVER_H
+#define ARRAYOBSERVER_H
+
+#include "ArrayDriver.h"
+
+// Host-side probe for the simulated GPIO ports.
+// Decodes the row/column pin levels after every output change into the set
+// of energized electrodes (row LOW and column HIGH), integrates on-time and
+// checks the result against the frame the driver was asked to show.
+typedef struct {
+    uint32_t gpioChanges;          // Output changes observed
+    uint32_t ghostChanges;         // Changes that left an unexpected electrode energized
+    uint32_t multiRowChanges;      // Changes that left more than one row driven
+    ElectrodeFrame_t energizedUnion;   // Every electrode energized at any time
+    ElectrodeFrame_t ghostUnion;       // Energized electrodes not in the expected frame
+    uint32_t refreshes;            // Frame refreshes seen (first expected row driven)
+    uint64_t minRefreshPeriod_us;  // Shortest / longest interval between refreshes
+    uint64_t maxRefreshPeriod_us;
+    uint64_t observed_us;          // Time covered by onTime_us
+} ArrayObserverReport_t;
+
+class ArrayObserver {
+private:
+    GPIO_Pin_t rowPins[NUM_ROWS];
+    GPIO_Pin_t colPins[NUM_COLS];
+    
+    ElectrodeFrame_t expected;
+    ElectrodeFrame_t energized;
+    uint16_t drivenRows;
+    uint16_t markerRow;     // First non-empty row of the expected frame
+    uint64_t lastChange_us;
+    uint64_t lastRefresh_us;
+    uint64_t start_us;
+    
+    static void gpioHook(GPIO_TypeDef* port, void* context);
+    void sample();
+    void accumulate(uint64_t now);
+    
+public:
+    ArrayObserverReport_t report;
+    uint64_t onTime_us[NUM_ROWS][NUM_COLS];
+    
+    ArrayObserver();
+    
+    // Start observing; 'expectedFrame' is what the array should show
+    void attach(const ElectrodeFrame_t* expectedFrame);
+    void detach();
+    
+    // Close the current interval so onTime_us/observed_us are up to date
+    void finish();
+    
+    // Current decoded state
+    void getEnergized(ElectrodeFrame_t* frame);
+    uint16_t getDrivenRows();
+};
+
+#endif // ARRAYOBSERVER_H
@@ -0,0 +1,469 @@
+#include "stm32f4xx_hal.h"
+#include <stdio.h>
+#include <string.h>
+
+// Host implementation of the simulated HAL (see sim/stm32f4xx_hal.h)
+
+#define HOST_SIM_MAX_TIMERS 8
+
+typedef struct {
+    TIM_HandleTypeDef* htim;
+} HostSimTimer_t;
+
+GPIO_TypeDef HostSim_GPIOA;
+GPIO_TypeDef HostSim_GPIOB;
+GPIO_TypeDef HostSim_GPIOC;
+GPIO_TypeDef HostSim_GPIOD;
+GPIO_TypeDef HostSim_GPIOE;
+uint32_t HostSim_PRIMASK = 0;
+uint32_t HostSim_BASEPRI = 0;
+
+static uint64_t simMicros = 0;
+static HostSimTimer_t simTimers[HOST_SIM_MAX_TIMERS];
+static uint8_t numSimTimers = 0;
+static HostSim_GpioHook gpioHook = nullptr;
+static void* gpioHookContext = nullptr;
+
+uint8_t HostSim_Flash[HOST_SIM_FLASH_SIZE];
+static bool flashLocked = true;
+static const char* flashFile = nullptr;
+
+// ============================================================================
+// GPIO
+// ============================================================================
+
+HostBsrrRegister& HostBsrrRegister::operator=(uint32_t value) {
+    GPIO_TypeDef* port = (GPIO_TypeDef*)((char*)this - offsetof(GPIO_TypeDef, BSRR));
+    
+    // Reset half first, set half wins when both bits are written
+    port->ODR = (port->ODR & ~(value >> 16U)) | (value & 0xFFFFU);
+    lastWrite = value;
+    
+    if (gpioHook) {
+        gpioHook(port, gpioHookContext);
+    }
+    return *this;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {
+    (void)GPIOx;
+    (void)GPIO_Init;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+    GPIOx->BSRR = (PinState != GPIO_PIN_RESET) ? (uint32_t)GPIO_Pin : (uint32_t)GPIO_Pin << 16U;
+}
+
+// ============================================================================
+// DMA
+// ============================================================================
+
+static HostSimTimer_t* findTimer(TIM_HandleTypeDef* htim, bool create);
+
+// Store one word at a DMA destination, honouring simulated register semantics
+static void dmaWrite(uintptr_t destination, uint32_t value) {
+    GPIO_TypeDef* ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE};
+    for (uint8_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++) {
+        if (destination == (uintptr_t)&ports[i]->BSRR) {
+            ports[i]->BSRR = value;
+            return;
+        }
+    }
+    
+    for (uint8_t i = 0; i < numSimTimers; i++) {
+        if (destination == (uintptr_t)&simTimers[i].htim->Instance->ARR) {
+            simTimers[i].htim->Instance->ARR = value;
+            return;
+        }
+    }
+    
+    *(volatile uint32_t*)destination = value;
+}
+
+static HAL_StatusTypeDef dmaStart(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress,
+                                  uintptr_t DstAddress, uint32_t DataLength, bool interrupts) {
+    if (!hdma || DataLength == 0) return HAL_ERROR;
+    if (hdma->simActive) return HAL_BUSY;
+    hdma->simSource = (const uint32_t*)SrcAddress;
+    hdma->simDestination = DstAddress;
+    hdma->simLength = DataLength;
+    hdma->simIndex = 0;
+    hdma->simInterrupts = interrupts;
+    hdma->simActive = true;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress,
+                                uintptr_t DstAddress, uint32_t DataLength) {
+    return dmaStart(hdma, SrcAddress, DstAddress, DataLength, false);
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress,
+                                   uintptr_t DstAddress, uint32_t DataLength) {
+    return dmaStart(hdma, SrcAddress, DstAddress, DataLength, true);
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma) {
+    if (!hdma) return HAL_ERROR;
+    hdma->simActive = false;
+    return HAL_OK;
+}
+
+// Serve one peripheral request: move a word, then raise HT/TC
+static void dmaRequest(DMA_HandleTypeDef* hdma) {
+    if (!hdma || !hdma->simActive) {
+        return;
+    }
+    
+    dmaWrite(hdma->simDestination, hdma->simSource[hdma->simIndex]);
+    hdma->simIndex++;
+    
+    if (hdma->simIndex == hdma->simLength / 2U) {
+        if (hdma->simInterrupts && hdma->XferHalfCpltCallback) {
+            hdma->XferHalfCpltCallback(hdma);
+        }
+    }
+    
+    if (hdma->simIndex >= hdma->simLength) {
+        hdma->simIndex = 0;
+        if (hdma->Init.Mode != DMA_CIRCULAR) {
+            hdma->simActive = false;
+        }
+        if (hdma->simInterrupts && hdma->XferCpltCallback) {
+            hdma->XferCpltCallback(hdma);
+        }
+    }
+}
+
+// ============================================================================
+// TIMERS
+// ============================================================================
+
+HostArrRegister& HostArrRegister::operator=(uint32_t value) {
+    TIM_TypeDef* tim = (TIM_TypeDef*)((char*)this - offsetof(TIM_TypeDef, ARR));
+    
+    preload = value;
+    if (!(tim->CR1 & TIM_CR1_ARPE)) {
+        shadow = value;
+    }
+    return *this;
+}
+
+static HostSimTimer_t* findTimer(TIM_HandleTypeDef* htim, bool create) {
+    for (uint8_t i = 0; i < numSimTimers; i++) {
+        if (simTimers[i].htim == htim) {
+            return &simTimers[i];
+        }
+    }
+    
+    if (!create || numSimTimers >= HOST_SIM_MAX_TIMERS) {
+        return nullptr;
+    }
+    
+    HostSimTimer_t* timer = &simTimers[numSimTimers++];
+    timer->htim = htim;
+    return timer;
+}
+
+static bool timerRunning(const HostSimTimer_t* timer) {
+    return (timer->htim->Instance->CR1 & TIM_CR1_CEN) != 0;
+}
+
+// Set/clear DIER bits; the counter runs while any start call is active
+static HAL_StatusTypeDef timerControl(TIM_HandleTypeDef* htim, uint32_t dier, bool enable) {
+    HostSimTimer_t* timer = findTimer(htim, true);
+    if (!timer) return HAL_ERROR;
+    
+    TIM_TypeDef* tim = htim->Instance;
+    if (enable) {
+        tim->DIER |= dier;
+        tim->CR1 |= TIM_CR1_CEN;
+    } else {
+        tim->DIER &= ~dier;
+        if ((tim->DIER & 0x1FFFU) == 0) {
+            tim->CR1 &= ~TIM_CR1_CEN;
+        }
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim) {
+    HostSimTimer_t* timer = findTimer(htim, true);
+    if (!timer) return HAL_ERROR;
+    htim->Instance->CR1 |= TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef* htim) {
+    HostSimTimer_t* timer = findTimer(htim, true);
+    if (!timer) return HAL_ERROR;
+    htim->Instance->CR1 &= ~TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim) {
+    return timerControl(htim, TIM_IT_UPDATE, true);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim) {
+    return timerControl(htim, TIM_IT_UPDATE, false);
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return timerControl(htim, TIM_IT_CC1 << (Channel >> 2U), true);
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_Stop_IT(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return timerControl(htim, TIM_IT_CC1 << (Channel >> 2U), false);
+}
+
+__attribute__((weak)) void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim) {
+    (void)htim;
+}
+
+__attribute__((weak)) void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef* htim) {
+    (void)htim;
+}
+
+// Compare channels that raise an interrupt or a DMA request
+static uint8_t activeChannels(const TIM_TypeDef* tim) {
+    return (uint8_t)(((tim->DIER >> 1U) | (tim->DIER >> 9U)) & 0x0FU);
+}
+
+// Ticks until the counter reaches 'target' (counting up, wrapping after ARR)
+static uint64_t ticksUntil(const TIM_TypeDef* tim, uint32_t target) {
+    if (target > tim->CNT) {
+        return target - tim->CNT;
+    }
+    return (uint64_t)(tim->ARR.shadow - tim->CNT) + 1U + target;
+}
+
+// Ticks until this timer's next event
+static uint64_t nextEventTicks(const HostSimTimer_t* timer) {
+    const TIM_TypeDef* tim = timer->htim->Instance;
+    uint64_t next = (uint64_t)(tim->ARR.shadow - tim->CNT) + 1U;  // Update event
+    uint8_t channels = activeChannels(tim);
+    
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        if (!(channels & (1U << ch))) continue;
+        uint32_t ccr = *(&tim->CCR1 + ch);
+        if (ccr > tim->ARR.shadow) continue;  // Never matches
+        uint64_t ticks = ticksUntil(tim, ccr);
+        if (ticks < next) next = ticks;
+    }
+    return next;
+}
+
+// Advance one timer; returns true if its counter wrapped (update event)
+static bool advanceTimer(HostSimTimer_t* timer, uint64_t ticks) {
+    TIM_TypeDef* tim = timer->htim->Instance;
+    uint64_t period = (uint64_t)tim->ARR.shadow + 1U;
+    uint64_t cnt = (uint64_t)tim->CNT + ticks;
+    tim->CNT = (uint32_t)(cnt % period);
+    
+    if (cnt < period) {
+        return false;
+    }
+    
+    // Update event: preloaded ARR becomes active
+    tim->ARR.shadow = tim->ARR.preload;
+    return true;
+}
+
+// Dispatch one instant: DMA requests first (hardware), then the interrupt
+// callbacks in HAL_TIM_IRQHandler order (capture/compare, then update)
+static void fireEvents(HostSimTimer_t* timer, bool updated) {
+    TIM_HandleTypeDef* htim = timer->htim;
+    TIM_TypeDef* tim = htim->Instance;
+    uint8_t matched = 0;
+    
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        if ((activeChannels(tim) & (1U << ch)) && *(&tim->CCR1 + ch) == tim->CNT) {
+            matched |= (uint8_t)(1U << ch);
+        }
+    }
+    
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        if ((matched & (1U << ch)) && (tim->DIER & (TIM_DMA_CC1 << ch))) {
+            dmaRequest(htim->hdma[TIM_DMA_ID_CC1 + ch]);
+        }
+    }
+    if (updated && (tim->DIER & TIM_DMA_UPDATE)) {
+        dmaRequest(htim->hdma[TIM_DMA_ID_UPDATE]);
+    }
+    
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        if ((matched & (1U << ch)) && (tim->DIER & (TIM_IT_CC1 << ch))) {
+            htim->Channel = (HAL_TIM_ActiveChannel)(1U << ch);
+            HAL_TIM_OC_DelayElapsedCallback(htim);
+            htim->Channel = HAL_TIM_ACTIVE_CHANNEL_CLEARED;
+        }
+    }
+    if (updated && (tim->DIER & TIM_IT_UPDATE)) {
+        HAL_TIM_PeriodElapsedCallback(htim);
+    }
+}
+
+// ============================================================================
+// FLASH
+// ============================================================================
+
+// Flash leaves the factory erased
+static struct HostSimFlashErased {
+    HostSimFlashErased() { memset(HostSim_Flash, 0xFF, sizeof(HostSim_Flash)); }
+} flashErased;
+
+// Offset and size of a sector in the 1 MB layout
+static bool sectorRange(uint32_t sector, uint32_t* offset, uint32_t* size) {
+    if (sector < 4) {
+        *offset = sector * 0x4000U;
+        *size = 0x4000U;
+    } else if (sector == 4) {
+        *offset = 0x10000U;
+        *size = 0x10000U;
+    } else if (sector < 12) {
+        *offset = (sector - 4) * 0x20000U;
+        *size = 0x20000U;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool HostSim_SetFlashFile(const char* path) {
+    flashFile = path;
+    memset(HostSim_Flash, 0xFF, sizeof(HostSim_Flash));
+    
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    size_t bytesRead = fread(HostSim_Flash, 1, sizeof(HostSim_Flash), file);
+    fclose(file);
+    return bytesRead == sizeof(HostSim_Flash);
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+    flashLocked = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+    flashLocked = true;
+    if (flashFile) {
+        FILE* file = fopen(flashFile, "wb");
+        if (!file) {
+            return HAL_ERROR;
+        }
+        fwrite(HostSim_Flash, 1, sizeof(HostSim_Flash), file);
+        fclose(file);
+    }
+    return HAL_OK;
+}
+
+// Programming clears bits only (erased state is 1)
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uintptr_t Address, uint64_t Data) {
+    uint32_t size = (TypeProgram == FLASH_TYPEPROGRAM_WORD) ? 4U :
+                    (TypeProgram == FLASH_TYPEPROGRAM_HALFWORD) ? 2U : 1U;
+    if (flashLocked || Address < FLASH_BASE || Address + size > FLASH_BASE + HOST_SIM_FLASH_SIZE ||
+        (Address & (size - 1U)) != 0) {
+        return HAL_ERROR;
+    }
+    
+    uint8_t* cell = &HostSim_Flash[Address - FLASH_BASE];
+    for (uint32_t i = 0; i < size; i++) {
+        cell[i] &= (uint8_t)(Data >> (8U * i));
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* SectorError) {
+    *SectorError = 0xFFFFFFFFU;
+    if (flashLocked || pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS) {
+        return HAL_ERROR;
+    }
+    
+    for (uint32_t i = 0; i < pEraseInit->NbSectors; i++) {
+        uint32_t offset, size;
+        if (!sectorRange(pEraseInit->Sector + i, &offset, &size)) {
+            *SectorError = pEraseInit->Sector + i;
+            return HAL_ERROR;
+        }
+        memset(&HostSim_Flash[offset], 0xFF, size);
+    }
+    return HAL_OK;
+}
+
+// ============================================================================
+// CLOCK
+// ============================================================================
+
+void HostSim_Reset() {
+    simMicros = 0;
+    numSimTimers = 0;
+    gpioHook = nullptr;
+    gpioHookContext = nullptr;
+    HostSim_PRIMASK = 0;
+    HostSim_BASEPRI = 0;
+}
+
+uint64_t HostSim_Micros() {
+    return simMicros;
+}
+
+void HostSim_SetGpioHook(HostSim_GpioHook hook, void* context) {
+    gpioHook = hook;
+    gpioHookContext = context;
+}
+
+// Advance simulated time, delivering timer interrupts in time order
+void HostSim_AdvanceMicros(uint64_t micros) {
+    uint64_t target = simMicros + micros;
+    
+    while (simMicros < target) {
+        uint64_t step = target - simMicros;
+        for (uint8_t i = 0; i < numSimTimers; i++) {
+            if (!timerRunning(&simTimers[i])) continue;
+            uint64_t ticks = nextEventTicks(&simTimers[i]);
+            if (ticks < step) step = ticks;
+        }
+        
+        bool updated[HOST_SIM_MAX_TIMERS];
+        uint8_t count = numSimTimers;
+        for (uint8_t i = 0; i < count; i++) {
+            updated[i] = timerRunning(&simTimers[i]) && advanceTimer(&simTimers[i], step);
+        }
+        simMicros += step;
+        
+        // Only timers whose event lands exactly on this instant fire
+        for (uint8_t i = 0; i < count; i++) {
+            if (timerRunning(&simTimers[i])) {
+                fireEvents(&simTimers[i], updated[i]);
+            }
+        }
+    }
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(simMicros / 1000U);
+}
+
+// Same behaviour as the HAL: waits until the 1 ms tick has advanced by
+// Delay + 1, so every call ends on a tick edge.
+void HAL_Delay(uint32_t Delay) {
+    uint64_t tickStart = simMicros / 1000U;
+    uint64_t wait = (Delay < 0xFFFFFFFFU) ? (uint64_t)Delay + 1U : Delay;
+    HostSim_AdvanceMicros((tickStart + wait) * 1000U - simMicros);
+}
+
+// ============================================================================
+// UART
+// ============================================================================
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* pData,
+                                    uint16_t Size, uint32_t Timeout) {
+    (void)huart;
+    (void)Timeout;
+    fwrite(pData, 1, Size, stdout);
+    return HAL_OK;
+}
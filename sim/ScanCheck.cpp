@@ -0,0 +1,88 @@
+// Host check of the row-scan engine: a frame that ghosts under static drive
+// must be shown without ghost activations at the programmed refresh period.
+//
+// Build and run from the repository root (exit status 0 = pass):
+//   g++ -std=c++17 -Isim -Iinclude -o scancheck src/*.cpp
+//       sim/HostHal.cpp sim/ArrayObserver.cpp sim/ScanCheck.cpp
+//   ./scancheck
+
+#include "ArrayDriver.h"
+#include "ArrayObserver.h"
+#include <stdio.h>
+
+#define CHECK_REFRESH_HZ 1000U
+#define CHECK_DUTY_PERCENT 80U
+#define CHECK_RUN_US 100000U   // 100 ms, 100 frames
+
+static ArrayDriver electrodeArray;
+static TIM_TypeDef tim3Registers;
+static TIM_HandleTypeDef htim3 = {&tim3Registers, HAL_TIM_ACTIVE_CHANNEL_CLEARED, {}};
+static int failures = 0;
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim) {
+    if (htim == &htim3) electrodeArray.scanTimerPeriodISR();
+}
+
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef* htim) {
+    if (htim == &htim3) electrodeArray.scanTimerCompareISR();
+}
+
+// Report one check
+static void check(bool ok, const char* what, unsigned long long value) {
+    printf("%s  %-40s %llu\n", ok ? "PASS" : "FAIL", what, value);
+    if (!ok) {
+        failures++;
+    }
+}
+
+int main() {
+    HostSim_Reset();
+    electrodeArray.init();
+
+    // Diagonal pair: static drive of rows 1,2 and columns 3,4 also
+    // energizes (1,4) and (2,3)
+    ElectrodeFrame_t frame;
+    frameClear(&frame);
+    frameSet(&frame, 1, 3, true);
+    frameSet(&frame, 2, 4, true);
+
+    ArrayObserver observer;
+
+    // Static drive: the observer must see the ghosts
+    observer.attach(&frame);
+    electrodeArray.setPattern(&frame);
+    HostSim_AdvanceMicros(1000);
+    observer.detach();
+    check(observer.report.ghostChanges > 0, "static drive ghosts (expected > 0)",
+          observer.report.ghostChanges);
+
+    // Row scan
+    electrodeArray.setAllElectrodesLow();
+    observer.attach(&frame);
+    check(electrodeArray.startScan(&htim3, CHECK_REFRESH_HZ, CHECK_DUTY_PERCENT),
+          "startScan", CHECK_REFRESH_HZ);
+    electrodeArray.setPattern(&frame);
+    HostSim_AdvanceMicros(CHECK_RUN_US);
+    observer.detach();
+    electrodeArray.stopScan();
+
+    const ArrayObserverReport_t* report = &observer.report;
+    uint64_t period = 1000000U / CHECK_REFRESH_HZ;
+    check(report->ghostChanges == 0, "scan ghost changes", report->ghostChanges);
+    check(report->multiRowChanges == 0, "scan multi-row changes", report->multiRowChanges);
+    check(frameEquals(&report->energizedUnion, &frame), "scan energized = frame", 1);
+    check(report->refreshes >= CHECK_RUN_US / period - 1, "scan refreshes", report->refreshes);
+    check(report->minRefreshPeriod_us == period, "scan min refresh period (us)",
+          report->minRefreshPeriod_us);
+    check(report->maxRefreshPeriod_us == period, "scan max refresh period (us)",
+          report->maxRefreshPeriod_us);
+
+    // Each electrode is on for the duty part of its row slot, every frame
+    uint64_t onTime = observer.onTime_us[1][3];
+    uint64_t expectedOn = (uint64_t)report->refreshes * period * CHECK_DUTY_PERCENT / 100U / NUM_ROWS;
+    check(onTime + period >= expectedOn && onTime <= expectedOn + period,
+          "scan on-time of (1,3) (us)", onTime);
+
+    printf("%s\n", failures ? "SCAN CHECK FAILED" : "SCAN CHECK OK");
+    return failures ? 1 : 0;
+}
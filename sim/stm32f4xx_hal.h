@@ -0,0 +1,321 @@
+#ifndef SIM_STM32F4XX_HAL_H
+#define SIM_STM32F4XX_HAL_H
+
+// Host simulation of the subset of the STM32F4 HAL used by the firmware.
+// Put sim/ ahead of the CubeMX include paths to build the driver on Linux:
+//   GPIO ports are plain structs whose BSRR stores update ODR,
+//   timers count at 1 MHz on a simulated clock and call the HAL callbacks,
+//   HAL_Delay()/HostSim_AdvanceMicros() advance that clock,
+//   internal flash is a RAM array that can be backed by a file.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+// ============================================================================
+// GPIO
+// ============================================================================
+
+// BSRR write-only register: low half sets ODR bits, high half resets them
+struct HostBsrrRegister {
+    uint32_t lastWrite;
+    HostBsrrRegister& operator=(uint32_t value);
+};
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    HostBsrrRegister BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003U
+
+extern GPIO_TypeDef HostSim_GPIOA;
+extern GPIO_TypeDef HostSim_GPIOB;
+extern GPIO_TypeDef HostSim_GPIOC;
+extern GPIO_TypeDef HostSim_GPIOD;
+extern GPIO_TypeDef HostSim_GPIOE;
+
+#define GPIOA (&HostSim_GPIOA)
+#define GPIOB (&HostSim_GPIOB)
+#define GPIOC (&HostSim_GPIOC)
+#define GPIOD (&HostSim_GPIOD)
+#define GPIOE (&HostSim_GPIOE)
+
+// ============================================================================
+// DMA
+// ============================================================================
+
+#define DMA_NORMAL 0x00000000U
+#define DMA_CIRCULAR 0x00000100U
+
+typedef struct {
+    uint32_t Mode;
+} DMA_InitTypeDef;
+
+// One stream; a request from the linked timer moves one 32-bit word
+typedef struct __DMA_HandleTypeDef {
+    DMA_InitTypeDef Init;
+    void* Parent;
+    void (*XferCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+    void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+    void (*XferErrorCallback)(struct __DMA_HandleTypeDef* hdma);
+    // Simulation state
+    const uint32_t* simSource;
+    uintptr_t simDestination;
+    uint32_t simLength;
+    uint32_t simIndex;
+    bool simActive;
+    bool simInterrupts;
+} DMA_HandleTypeDef;
+
+// ============================================================================
+// TIMERS
+// ============================================================================
+
+#define TIM_CR1_CEN 0x0001U
+#define TIM_CR1_ARPE 0x0080U
+
+#define TIM_IT_UPDATE 0x0001U
+#define TIM_IT_CC1 0x0002U
+#define TIM_DMA_UPDATE 0x0100U
+#define TIM_DMA_CC1 0x0200U
+#define TIM_DMA_CC2 0x0400U
+#define TIM_DMA_CC3 0x0800U
+#define TIM_DMA_CC4 0x1000U
+
+#define TIM_DMA_ID_UPDATE 0U
+#define TIM_DMA_ID_CC1 1U
+#define TIM_DMA_ID_CC2 2U
+#define TIM_DMA_ID_CC3 3U
+#define TIM_DMA_ID_CC4 4U
+
+// Auto-reload register with preload: while CR1.ARPE is set, writes only
+// reach the shadow value at the next update event
+struct HostArrRegister {
+    uint32_t preload;
+    uint32_t shadow;
+    HostArrRegister& operator=(uint32_t value);
+    operator uint32_t() const { return preload; }
+};
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t PSC;
+    volatile uint32_t CNT;
+    HostArrRegister ARR;
+    volatile uint32_t CCR1;
+    volatile uint32_t CCR2;
+    volatile uint32_t CCR3;
+    volatile uint32_t CCR4;
+} TIM_TypeDef;
+
+typedef enum {
+    HAL_TIM_ACTIVE_CHANNEL_1 = 0x01U,
+    HAL_TIM_ACTIVE_CHANNEL_2 = 0x02U,
+    HAL_TIM_ACTIVE_CHANNEL_3 = 0x04U,
+    HAL_TIM_ACTIVE_CHANNEL_4 = 0x08U,
+    HAL_TIM_ACTIVE_CHANNEL_CLEARED = 0x00U
+} HAL_TIM_ActiveChannel;
+
+typedef struct TIM_HandleTypeDef {
+    TIM_TypeDef* Instance;
+    HAL_TIM_ActiveChannel Channel;
+    DMA_HandleTypeDef* hdma[7];
+} TIM_HandleTypeDef;
+
+#define TIM_CHANNEL_1 0x00000000U
+#define TIM_CHANNEL_2 0x00000004U
+#define TIM_CHANNEL_3 0x00000008U
+#define TIM_CHANNEL_4 0x0000000CU
+
+#define __HAL_TIM_SET_COUNTER(h, v) ((h)->Instance->CNT = (v))
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_SET_AUTORELOAD(h, v) ((h)->Instance->ARR = (v))
+#define __HAL_TIM_GET_AUTORELOAD(h) ((h)->Instance->ARR)
+#define __HAL_TIM_SET_COMPARE(h, ch, v) \
+    (*(&(h)->Instance->CCR1 + ((ch) >> 2U)) = (v))
+#define __HAL_TIM_GET_COMPARE(h, ch) \
+    (*(&(h)->Instance->CCR1 + ((ch) >> 2U)))
+#define __HAL_TIM_ENABLE_DMA(h, d) ((h)->Instance->DIER |= (d))
+#define __HAL_TIM_DISABLE_DMA(h, d) ((h)->Instance->DIER &= ~(d))
+
+// ============================================================================
+// UART
+// ============================================================================
+
+typedef struct {
+    int id;
+} UART_HandleTypeDef;
+
+// ============================================================================
+// FLASH
+// ============================================================================
+
+// 1 MB, STM32F413xG sector layout: 4 x 16 KB, 64 KB, 7 x 128 KB.
+// FLASH_BASE is the host address of the array, so flash contents are read
+// through plain pointers as on the target.
+#define HOST_SIM_FLASH_SIZE 0x100000U
+
+extern uint8_t HostSim_Flash[HOST_SIM_FLASH_SIZE];
+
+#define FLASH_BASE ((uintptr_t)HostSim_Flash)
+
+#define FLASH_TYPEERASE_SECTORS 0x00000000U
+#define FLASH_VOLTAGE_RANGE_3 0x00000002U
+#define FLASH_BANK_1 1U
+
+#define FLASH_TYPEPROGRAM_BYTE 0x00000000U
+#define FLASH_TYPEPROGRAM_HALFWORD 0x00000001U
+#define FLASH_TYPEPROGRAM_WORD 0x00000002U
+
+#define FLASH_SECTOR_0 0U
+#define FLASH_SECTOR_1 1U
+#define FLASH_SECTOR_2 2U
+#define FLASH_SECTOR_3 3U
+#define FLASH_SECTOR_4 4U
+#define FLASH_SECTOR_5 5U
+#define FLASH_SECTOR_6 6U
+#define FLASH_SECTOR_7 7U
+#define FLASH_SECTOR_8 8U
+#define FLASH_SECTOR_9 9U
+#define FLASH_SECTOR_10 10U
+#define FLASH_SECTOR_11 11U
+
+typedef struct {
+    uint32_t TypeErase;
+    uint32_t Banks;
+    uint32_t Sector;
+    uint32_t NbSectors;
+    uint32_t VoltageRange;
+} FLASH_EraseInitTypeDef;
+
+// ============================================================================
+// CORE
+// ============================================================================
+
+// Interrupts are only delivered from HostSim_AdvanceMicros()/HAL_Delay(),
+// so masking is bookkeeping only.
+#define __NVIC_PRIO_BITS 4U
+
+extern uint32_t HostSim_PRIMASK;
+extern uint32_t HostSim_BASEPRI;
+
+static inline void __disable_irq(void) { HostSim_PRIMASK = 1U; }
+static inline void __enable_irq(void) { HostSim_PRIMASK = 0U; }
+static inline uint32_t __get_BASEPRI(void) { return HostSim_BASEPRI; }
+static inline void __set_BASEPRI(uint32_t value) { HostSim_BASEPRI = value & 0xFFU; }
+// Only raises the mask (0 = no masking counts as lowest)
+static inline void __set_BASEPRI_MAX(uint32_t value) {
+    value &= 0xFFU;
+    if (value != 0 && (HostSim_BASEPRI == 0 || value < HostSim_BASEPRI)) {
+        HostSim_BASEPRI = value;
+    }
+}
+static inline void __DMB(void) { __asm__ volatile("" ::: "memory"); }
+static inline void __DSB(void) { __asm__ volatile("" ::: "memory"); }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress,
+                                uintptr_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress,
+                                   uintptr_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma);
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_OC_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_OC_Stop_IT(TIM_HandleTypeDef* htim, uint32_t Channel);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim);
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef* htim);
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* pData,
+                                    uint16_t Size, uint32_t Timeout);
+
+// Programming can only clear bits, as on the device; the flash must be
+// unlocked. Addresses are host pointers (uintptr_t) in the simulation.
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uintptr_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* SectorError);
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+#ifdef __cplusplus
+}
+#endif
+
+// ============================================================================
+// SIMULATION CONTROL
+// ============================================================================
+
+// Called after every GPIO output change (BSRR store or HAL_GPIO_WritePin)
+typedef void (*HostSim_GpioHook)(GPIO_TypeDef* port, void* context);
+
+void HostSim_Reset();
+uint64_t HostSim_Micros();
+void HostSim_AdvanceMicros(uint64_t micros);
+void HostSim_SetGpioHook(HostSim_GpioHook hook, void* context);
+
+// Back the simulated flash with a file: its contents are loaded now (all
+// erased if it does not exist) and written back by HAL_FLASH_Lock().
+// HostSim_Reset() leaves flash untouched.
+bool HostSim_SetFlashFile(const char* path);
+
+#endif // SIM_STM32F4XX_HAL_H
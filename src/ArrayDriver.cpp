@@ -1,63 +1,68 @@
 #include "ArrayDriver.h"
+#include "CriticalSection.h"
 #include <ctype.h>
 
 // Constructor
 ArrayDriver::ArrayDriver() {
-    // Initialize row GPIO lookup table
-    rowPins[0] = {ROW0_PORT, ROW0_PIN};
-    rowPins[1] = {ROW1_PORT, ROW1_PIN};
-    rowPins[2] = {ROW2_PORT, ROW2_PIN};
-    rowPins[3] = {ROW3_PORT, ROW3_PIN};
-    rowPins[4] = {ROW4_PORT, ROW4_PIN};
-    rowPins[5] = {ROW5_PORT, ROW5_PIN};
-    rowPins[6] = {ROW6_PORT, ROW6_PIN};
-    rowPins[7] = {ROW7_PORT, ROW7_PIN};
-    rowPins[8] = {ROW8_PORT, ROW8_PIN};
-    rowPins[9] = {ROW9_PORT, ROW9_PIN};
-    
-    // Initialize column GPIO lookup table
-    colPins[0] = {COL0_PORT, COL0_PIN};
-    colPins[1] = {COL1_PORT, COL1_PIN};
-    colPins[2] = {COL2_PORT, COL2_PIN};
-    colPins[3] = {COL3_PORT, COL3_PIN};
-    colPins[4] = {COL4_PORT, COL4_PIN};
-    colPins[5] = {COL5_PORT, COL5_PIN};
-    colPins[6] = {COL6_PORT, COL6_PIN};
-    colPins[7] = {COL7_PORT, COL7_PIN};
-    colPins[8] = {COL8_PORT, COL8_PIN};
-    colPins[9] = {COL9_PORT, COL9_PIN};
-    colPins[10] = {COL10_PORT, COL10_PIN};
-    colPins[11] = {COL11_PORT, COL11_PIN};
-    colPins[12] = {COL12_PORT, COL12_PIN};
-    colPins[13] = {COL13_PORT, COL13_PIN};
+    // Row and column GPIO lookup tables from the header macros
+    setMacroPinLayout();
     
     // Initialize all electrode states to low
-    for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        for (uint8_t col = 0; col < NUM_COLS; col++) {
-            electrodeState[row][col] = false;
-        }
-    }
+    frameClear(&electrodeState);
+    frameClear(&stagedState);
+    
+    // Pin levels unknown until the first write
+    drivenRows = 0;
+    drivenCols = 0;
+    drivenLinesValid = false;
+    
+    // Row-scan engine starts stopped (static row/column drive)
+    scanTimer = nullptr;
+    scanActive = false;
+    scanSwapPending = false;
+    scanActiveTable = 0;
+    scanRow = 0;
+    scanDutyPercent = 100;
+    scanRowTicks = 0;
     
     // Initialize sequence control variables
     sequenceRunning = false;
     currentStep = 0;
-    stepStartTime = 0;
+    currentCycle = 0;
+    sequenceStartTime = 0;
+    stepEnd_us = 0;
+    stepDuration_us = 0;
     currentSequence = nullptr;
+    sequenceTimer = nullptr;
+    stepDeadline = 0;
+    sequencePaused = false;
+    pausedRemaining_us = 0;
+    frameClear(&pausedFrame);
+    sequencePriority = 0;
+    preemptDepth = 0;
+    edgeCount = 0;
+    edgeLatencyMax = 0;
+    edgeLatencyLast = 0;
+    edgeLatencySum = 0;
     
-    // Load electrode mappings from JSON files
-    // This reads ElectrodeMap.json, PinMap.json, and PinDef.json at runtime
-    bool success = true;
-    success &= loadElectrodeMap(ELECTRODE_MAP_PATH);
-    success &= loadPinMap(PIN_MAP_PATH);
-    // PinDef is already hardcoded in the GPIO pin definitions above
-    
-    if (!success) {
-        // Handle error - mapping files couldn't be loaded
-        // For now, use default 1:1 mapping as fallback
-        for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
-            electrodeMap[i].row = i / NUM_COLS;
-            electrodeMap[i].col = i % NUM_COLS;
-        }
+    // Mapping: a compiled image needs no parsing at boot; the JSON files are
+    // only read when no valid image is found
+    mapping = &mappingTables[0];
+    mappingSource = MAPPING_SOURCE_DEFAULT;
+    pendingMapping = nullptr;
+    memset(&lastReload, 0, sizeof(lastReload));
+    memset(&mappingReport, 0, sizeof(mappingReport));
+    bool loaded = false;
+#ifdef MAPPING_IMAGE_ADDR
+    loaded = loadMappingImage((const MappingImage_t*)(MAPPING_IMAGE_ADDR), true);
+#endif
+    if (!loaded) {
+        loaded = loadMappingImageFile(MAPPING_IMAGE_PATH);
+    }
+    if (!loaded) {
+        // ElectrodeMap.json, PinMap.json and PinDef.json; 1:1 mapping if
+        // either map cannot be loaded
+        loadMappingJSON();
     }
 }
 
@@ -83,6 +88,9 @@ void ArrayDriver::init() {
         HAL_GPIO_WritePin(colPins[i].port, colPins[i].pin, GPIO_PIN_RESET);
     }
     
+    // Start the cycle counter used by the critical-section statistics
+    CriticalSection::resetStats();
+    
     // Set all electrodes to low state
     setAllElectrodesLow();
 }
@@ -104,25 +112,133 @@ inline void ArrayDriver::setColLow(uint8_t col) {
     HAL_GPIO_WritePin(colPins[col].port, colPins[col].pin, GPIO_PIN_RESET);
 }
 
-// Atomic set operation for minimal delay between row and column transitions
-inline void ArrayDriver::setRowColAtomic(uint8_t row, uint8_t col, bool state) {
-    // Disable interrupts for atomic operation
-    __disable_irq();
+// Find (or register) the port index used by the per-port BSRR tables
+uint8_t ArrayDriver::getPortIndex(GPIO_TypeDef* port) {
+    for (uint8_t i = 0; i < numGpioPorts; i++) {
+        if (gpioPorts[i] == port) {
+            return i;
+        }
+    }
+    
+    if (numGpioPorts >= MAX_GPIO_PORTS) {
+        return MAX_GPIO_PORTS;  // No room - line is skipped by the mask path
+    }
+    
+    gpioPorts[numGpioPorts] = port;
+    return numGpioPorts++;
+}
+
+// Build the line -> port index tables from rowPins/colPins
+void ArrayDriver::buildPortTables() {
+    numGpioPorts = 0;
     
-    if (state) {
-        // To drive electrode HIGH: Row LOW, Column HIGH
-        // Use BSRR register for atomic simultaneous operation
-        rowPins[row].port->BSRR = (uint32_t)rowPins[row].pin << 16U;  // Reset row (set low)
-        colPins[col].port->BSRR = colPins[col].pin;  // Set column high
-    } else {
-        // To drive electrode LOW: Row HIGH, Column LOW
-        // Use BSRR register for atomic simultaneous operation
-        rowPins[row].port->BSRR = rowPins[row].pin;  // Set row high
-        colPins[col].port->BSRR = (uint32_t)colPins[col].pin << 16U;  // Reset column (set low)
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        rowPortIndex[row] = getPortIndex(rowPins[row].port);
+    }
+    
+    for (uint8_t col = 0; col < NUM_COLS; col++) {
+        colPortIndex[col] = getPortIndex(colPins[col].port);
+    }
+}
+
+// Fold a frame into one BSRR word per port
+// A row is driven (LOW) when any electrode in it is active, a column is
+// driven (HIGH) when any electrode in it is active; all other lines idle.
+void ArrayDriver::compileFrame(const ElectrodeFrame_t* frame, uint32_t bsrr[MAX_GPIO_PORTS]) {
+    compileLines(frameActiveRows(frame), frameActiveCols(frame),
+                 (uint16_t)((1U << NUM_ROWS) - 1U), FRAME_ROW_MASK, bsrr);
+}
+
+// BSRR words for the selected lines only (unselected lines are left alone)
+void ArrayDriver::compileLines(uint16_t rowActive, uint16_t colActive,
+                               uint16_t rowSelect, uint16_t colSelect,
+                               uint32_t bsrr[MAX_GPIO_PORTS]) {
+    for (uint8_t i = 0; i < MAX_GPIO_PORTS; i++) {
+        bsrr[i] = 0;
+    }
+    
+    // Rows: active = reset (LOW), idle = set (HIGH)
+    while (rowSelect) {
+        uint8_t row = __builtin_ctz(rowSelect);
+        rowSelect &= rowSelect - 1U;
+        if (rowPortIndex[row] >= MAX_GPIO_PORTS) continue;
+        uint32_t pin = rowPins[row].pin;
+        bsrr[rowPortIndex[row]] |= (rowActive & (1U << row)) ? (pin << 16U) : pin;
+    }
+    
+    // Columns: active = set (HIGH), idle = reset (LOW)
+    while (colSelect) {
+        uint8_t col = __builtin_ctz(colSelect);
+        colSelect &= colSelect - 1U;
+        if (colPortIndex[col] >= MAX_GPIO_PORTS) continue;
+        uint32_t pin = colPins[col].pin;
+        bsrr[colPortIndex[col]] |= (colActive & (1U << col)) ? pin : (pin << 16U);
+    }
+}
+
+// Number of distinct GPIO ports used by the lines
+uint8_t ArrayDriver::getNumGpioPorts() {
+    return numGpioPorts;
+}
+
+// GPIO port for a port index (as used by compileFrame)
+GPIO_TypeDef* ArrayDriver::getGpioPort(uint8_t index) {
+    return (index < numGpioPorts) ? gpioPorts[index] : nullptr;
+}
+
+// Forget the tracked line levels (e.g. after DMA playback drove the pins)
+void ArrayDriver::invalidateDrivenLines() {
+    drivenLinesValid = false;
+}
+
+// Write precompiled BSRR words, at most one store per port
+// Returns the number of BSRR stores issued
+uint8_t ArrayDriver::writePortMasks(const uint32_t bsrr[MAX_GPIO_PORTS]) {
+    uint8_t writes = 0;
+    
+    CriticalSection lock;
+    for (uint8_t i = 0; i < numGpioPorts; i++) {
+        if (bsrr[i] != 0) {
+            gpioPorts[i]->BSRR = bsrr[i];
+            writes++;
+        }
+    }
+    
+    return writes;
+}
+
+// Drive the current electrodeState to the outputs
+// Static drive only writes the lines whose level differs from the last
+// write; returns the number of BSRR stores issued. The sequence timer ISR
+// drives frames too, so the compute, the write and the line tracking form
+// one critical section (setters also hold one around their frame edit).
+uint8_t ArrayDriver::driveFrame() {
+    CriticalSection lock;
+    if (scanActive) {
+        loadScanTables();
+        return 0;
+    }
+    
+    uint16_t rowActive = frameActiveRows(&electrodeState);
+    uint16_t colActive = frameActiveCols(&electrodeState);
+    uint16_t rowChanged = (uint16_t)((1U << NUM_ROWS) - 1U);
+    uint16_t colChanged = FRAME_ROW_MASK;
+    if (drivenLinesValid) {
+        rowChanged = rowActive ^ drivenRows;
+        colChanged = colActive ^ drivenCols;
+        if (!rowChanged && !colChanged) {
+            return 0;
+        }
     }
     
-    // Re-enable interrupts
-    __enable_irq();
+    uint32_t bsrr[MAX_GPIO_PORTS];
+    compileLines(rowActive, colActive, rowChanged, colChanged, bsrr);
+    uint8_t writes = writePortMasks(bsrr);
+    
+    drivenRows = rowActive;
+    drivenCols = colActive;
+    drivenLinesValid = true;
+    return writes;
 }
 
 // Set electrode to specific state
@@ -131,8 +247,20 @@ void ArrayDriver::setElectrode(uint8_t row, uint8_t col, bool state) {
         return;  // Invalid indices
     }
     
-    setRowColAtomic(row, col, state);
-    electrodeState[row][col] = state;
+    CriticalSection lock;
+    frameSet(&electrodeState, row, col, state);
+    frameSet(&stagedState, row, col, state);
+    
+    driveFrame();
+}
+
+// Apply a sequence step: one electrode, or a whole frame in one transition
+void ArrayDriver::applyStep(const ElectrodeStep_t* step) {
+    if (step->frame) {
+        setPattern(step->frame);
+    } else {
+        setElectrode(step->row, step->col, step->state);
+    }
 }
 
 // Set electrode HIGH
@@ -151,9 +279,13 @@ bool ArrayDriver::getRowColFromElectrode(uint8_t electrodeNum, uint8_t* row, uin
         return false;  // Invalid electrode number
     }
     
-    // Use the mapping table loaded from JSON files at runtime
-    *row = electrodeMap[electrodeNum - 1].row;
-    *col = electrodeMap[electrodeNum - 1].col;
+    // Resolved table of the compiled image or the JSON files
+    const ElectrodeMapping_t* cell = &mapping->electrodes[electrodeNum - 1];
+    if (cell->row == MAPPING_UNMAPPED) {
+        return false;  // No cell in the mapping files
+    }
+    *row = cell->row;
+    *col = cell->col;
     return true;
 }
 
@@ -177,76 +309,54 @@ void ArrayDriver::setElectrodeLowByNumber(uint8_t electrodeNum) {
 
 // Set all electrodes LOW
 void ArrayDriver::setAllElectrodesLow() {
-    // Disable interrupts for bulk operation
-    __disable_irq();
-    
     // To drive electrodes LOW: Rows HIGH, Columns LOW
-    // Set all rows HIGH
-    for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        rowPins[row].port->BSRR = rowPins[row].pin;
-    }
-    
-    // Set all columns LOW
-    for (uint8_t col = 0; col < NUM_COLS; col++) {
-        colPins[col].port->BSRR = (uint32_t)colPins[col].pin << 16U;
-    }
-    
-    __enable_irq();
-    
-    // Update state array
-    for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        for (uint8_t col = 0; col < NUM_COLS; col++) {
-            electrodeState[row][col] = false;
-        }
-    }
+    CriticalSection lock;
+    frameClear(&electrodeState);
+    frameClear(&stagedState);
+    driveFrame();
 }
 
 // Set all electrodes HIGH
 void ArrayDriver::setAllElectrodesHigh() {
-    // Disable interrupts for bulk operation
-    __disable_irq();
-    
     // To drive electrodes HIGH: Rows LOW, Columns HIGH
-    // Set all rows LOW
-    for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        rowPins[row].port->BSRR = (uint32_t)rowPins[row].pin << 16U;
-    }
-    
-    // Set all columns HIGH
-    for (uint8_t col = 0; col < NUM_COLS; col++) {
-        colPins[col].port->BSRR = colPins[col].pin;
-    }
-    
-    __enable_irq();
-    
-    // Update state array
-    for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        for (uint8_t col = 0; col < NUM_COLS; col++) {
-            electrodeState[row][col] = true;
-        }
-    }
+    CriticalSection lock;
+    frameFill(&electrodeState);
+    frameFill(&stagedState);
+    driveFrame();
 }
 
 // Set all electrodes in a row to specific state
+// One word store in the frame, one delta write (single critical section)
 void ArrayDriver::setRowElectrodes(uint8_t row, bool state) {
     if (row >= NUM_ROWS) {
         return;
     }
     
-    for (uint8_t col = 0; col < NUM_COLS; col++) {
-        setElectrode(row, col, state);
-    }
+    CriticalSection lock;
+    electrodeState.rows[row] = state ? FRAME_ROW_MASK : 0;
+    stagedState.rows[row] = electrodeState.rows[row];
+    driveFrame();
 }
 
 // Set all electrodes in a column to specific state
+// Column bit set/cleared in every row word, then one delta write
 void ArrayDriver::setColElectrodes(uint8_t col, bool state) {
     if (col >= NUM_COLS) {
         return;
     }
     
+    uint16_t bit = (uint16_t)(1U << col);
+    CriticalSection lock;
     for (uint8_t row = 0; row < NUM_ROWS; row++) {
-        setElectrode(row, col, state);
+        if (state) {
+            electrodeState.rows[row] |= bit;
+            stagedState.rows[row] |= bit;
+        } else {
+            electrodeState.rows[row] &= (uint16_t)~bit;
+            stagedState.rows[row] &= (uint16_t)~bit;
+        }
     }
+    driveFrame();
 }
 
 // Get electrode state
@@ -254,295 +364,1683 @@ bool ArrayDriver::getElectrodeState(uint8_t row, uint8_t col) {
     if (row >= NUM_ROWS || col >= NUM_COLS) {
         return false;
     }
-    return electrodeState[row][col];
+    return frameGet(&electrodeState, row, col);
+}
+
+// Set pattern from frame
+// Only the rows/columns whose drive level changes are compiled into per-port
+// BSRR words and written in one critical section (at most one store per
+// GPIO port). Returns the number of BSRR stores issued.
+uint8_t ArrayDriver::setPattern(const ElectrodeFrame_t* frame) {
+    if (!frame) {
+        return 0;
+    }
+    
+    ElectrodeFrame_t target;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        target.rows[row] = frame->rows[row] & FRAME_ROW_MASK;
+    }
+    
+    CriticalSection lock;
+    stagedState = target;
+    
+    // XOR delta: an unchanged frame needs no register writes
+    ElectrodeFrame_t delta;
+    frameXor(&delta, &target, &electrodeState);
+    if (frameActiveRows(&delta) == 0 && (drivenLinesValid || scanActive)) {
+        return 0;
+    }
+    
+    electrodeState = target;
+    return driveFrame();
+}
+
+// Get current pattern as a frame
+void ArrayDriver::getPattern(ElectrodeFrame_t* frame) {
+    if (frame) {
+        CriticalSection lock;
+        *frame = electrodeState;
+    }
 }
 
 // Set pattern from array
 void ArrayDriver::setPattern(bool pattern[NUM_ROWS][NUM_COLS]) {
+    ElectrodeFrame_t frame;
+    frameClear(&frame);
     for (uint8_t row = 0; row < NUM_ROWS; row++) {
         for (uint8_t col = 0; col < NUM_COLS; col++) {
-            setElectrode(row, col, pattern[row][col]);
+            frameSet(&frame, row, col, pattern[row][col]);
         }
     }
+    setPattern(&frame);
 }
 
-// Get current pattern
+// Get current pattern as an array
 void ArrayDriver::getPattern(bool pattern[NUM_ROWS][NUM_COLS]) {
+    CriticalSection lock;
     for (uint8_t row = 0; row < NUM_ROWS; row++) {
         for (uint8_t col = 0; col < NUM_COLS; col++) {
-            pattern[row][col] = electrodeState[row][col];
+            pattern[row][col] = frameGet(&electrodeState, row, col);
         }
     }
 }
 
 // ============================================================================
-// MICROFLUIDICS/PCR TEST SCENARIOS
+// DOUBLE-BUFFERED FRAME (stage + commit)
 // ============================================================================
 
-// Execute sequence synchronously (blocking)
-void ArrayDriver::executeSequence(const ElectrodeSequence_t* sequence) {
-    if (!sequence || !sequence->steps) {
+// Stage one electrode in the back buffer (no output change)
+void ArrayDriver::stageElectrode(uint8_t row, uint8_t col, bool state) {
+    if (row >= NUM_ROWS || col >= NUM_COLS) {
         return;
     }
-    
-    for (uint32_t cycle = 0; cycle < sequence->cycleCount; cycle++) {
-        for (uint16_t step = 0; step < sequence->numSteps; step++) {
-            const ElectrodeStep_t* currentStep = &sequence->steps[step];
-            
-            // Set electrode state
-            setElectrode(currentStep->row, currentStep->col, currentStep->state);
-            
-            // Wait for duration
-            HAL_Delay(currentStep->duration_ms);
-        }
-        
-        // Delay between cycles (except for last cycle)
-        if (cycle < sequence->cycleCount - 1) {
-            HAL_Delay(sequence->cycleDelay_ms);
+    CriticalSection lock;
+    frameSet(&stagedState, row, col, state);
+}
+
+// Stage one electrode by number (1-140)
+void ArrayDriver::stageElectrodeByNumber(uint8_t electrodeNum, bool state) {
+    uint8_t row, col;
+    if (getRowColFromElectrode(electrodeNum, &row, &col)) {
+        stageElectrode(row, col, state);
+    }
+}
+
+// Stage all electrodes in a row
+void ArrayDriver::stageRowElectrodes(uint8_t row, bool state) {
+    if (row >= NUM_ROWS) {
+        return;
+    }
+    CriticalSection lock;
+    stagedState.rows[row] = state ? FRAME_ROW_MASK : 0;
+}
+
+// Stage all electrodes in a column
+void ArrayDriver::stageColElectrodes(uint8_t col, bool state) {
+    if (col >= NUM_COLS) {
+        return;
+    }
+    uint16_t bit = (uint16_t)(1U << col);
+    CriticalSection lock;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        if (state) {
+            stagedState.rows[row] |= bit;
+        } else {
+            stagedState.rows[row] &= (uint16_t)~bit;
         }
     }
 }
 
-// Execute sequence asynchronously (non-blocking)
-void ArrayDriver::executeSequenceAsync(const ElectrodeSequence_t* sequence) {
-    if (!sequence || !sequence->steps) {
+// Replace the whole back buffer
+void ArrayDriver::stagePattern(const ElectrodeFrame_t* frame) {
+    if (!frame) {
         return;
     }
-    
-    currentSequence = const_cast<ElectrodeSequence_t*>(sequence);
-    sequenceRunning = true;
-    currentStep = 0;
-    stepStartTime = HAL_GetTick();
+    CriticalSection lock;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        stagedState.rows[row] = frame->rows[row] & FRAME_ROW_MASK;
+    }
 }
 
-// Check if sequence is running
-bool ArrayDriver::isSequenceRunning() {
-    return sequenceRunning;
+// Get the back buffer
+void ArrayDriver::getStagedPattern(ElectrodeFrame_t* frame) {
+    if (frame) {
+        CriticalSection lock;
+        *frame = stagedState;
+    }
 }
 
-// Stop current sequence
-void ArrayDriver::stopSequence() {
-    sequenceRunning = false;
-    currentSequence = nullptr;
-    currentStep = 0;
+// Check if the back buffer differs from the driven frame
+bool ArrayDriver::hasStagedChanges() {
+    CriticalSection lock;
+    return !frameEquals(&stagedState, &electrodeState);
 }
 
-// ============================================================================
-// TEST SCENARIOS - User provides custom electrode sequences
-// ============================================================================
+// Drop staged edits (back buffer = current frame)
+void ArrayDriver::discardStaged() {
+    CriticalSection lock;
+    stagedState = electrodeState;
+}
 
-// Run a test sequence on specified electrodes (by number 1-140)
-void ArrayDriver::runElectrodeSequenceTest(uint8_t* electrodeNumbers, uint16_t numElectrodes, uint32_t duration_ms) {
-    for (uint16_t i = 0; i < numElectrodes; i++) {
-        setElectrodeHighByNumber(electrodeNumbers[i]);
-        HAL_Delay(duration_ms);
-        setElectrodeLowByNumber(electrodeNumbers[i]);
+// Apply the back buffer as one transition
+// Static drive: one critical section, at most one BSRR store per port.
+// Row scanning: the new tables are swapped in by the ISR at the next frame
+// boundary (see isCommitPending()). Returns false if nothing was staged.
+bool ArrayDriver::commit() {
+    CriticalSection lock;
+    if (frameEquals(&stagedState, &electrodeState)) {
+        return false;
     }
+    
+    electrodeState = stagedState;
+    driveFrame();
+    return true;
 }
 
-// Sequential test of all electrodes (1-140)
-void ArrayDriver::runElectrodeTest() {
-    for (uint8_t electrodeNum = 1; electrodeNum <= NUM_ELECTRODES; electrodeNum++) {
-        setElectrodeHighByNumber(electrodeNum);
-        HAL_Delay(100);  // 100ms per electrode
-        setElectrodeLowByNumber(electrodeNum);
-    }
+// Check if a committed frame is still waiting for the scan frame boundary
+bool ArrayDriver::isCommitPending() {
+    return scanActive && scanSwapPending;
 }
 
 // ============================================================================
-// JSON FILE READING AND PARSING
+// ROW-SCAN MULTIPLEXING
 // ============================================================================
 
-// Read file from filesystem (implement based on your platform)
-char* ArrayDriver::readFile(const char* filepath, size_t* fileSize) {
-    // For STM32 with FatFS or LittleFS
-    FILE* file = fopen(filepath, "r");
-    if (!file) {
-        return nullptr;
-    }
+// Compile one BSRR word set per row slot: that row active with its own
+// column mask, every other line idle. Empty rows compile to all-idle.
+void ArrayDriver::buildScanTables(uint32_t tables[NUM_ROWS][MAX_GPIO_PORTS]) {
+    ElectrodeFrame_t slot;
+    frameClear(&slot);
     
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    *fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    // Allocate buffer
-    char* buffer = (char*)malloc(*fileSize + 1);
-    if (!buffer) {
-        fclose(file);
-        return nullptr;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        slot.rows[row] = electrodeState.rows[row];
+        compileFrame(&slot, tables[row]);
+        slot.rows[row] = 0;
+    }
+}
+
+// Stage the current frame into the back scan table; the ISR swaps it in at
+// the next frame boundary so a refresh never mixes two frames.
+void ArrayDriver::loadScanTables() {
+    scanSwapPending = false;
+    uint8_t back = scanActiveTable ^ 1U;
+    buildScanTables(scanTables[back]);
+    __DMB();
+    scanSwapPending = true;
+}
+
+// Write one BSRR word per port from interrupt context
+inline void ArrayDriver::writeScanWord(const uint32_t bsrr[MAX_GPIO_PORTS]) {
+    for (uint8_t i = 0; i < numGpioPorts; i++) {
+        if (bsrr[i] != 0) {
+            gpioPorts[i]->BSRR = bsrr[i];
+        }
     }
-    
-    // Read file
-    size_t bytesRead = fread(buffer, 1, *fileSize, file);
-    buffer[bytesRead] = '\0';
-    
-    fclose(file);
-    return buffer;
 }
 
-// Find JSON value for a given key
-const char* ArrayDriver::findJSONValue(const char* json, const char* key) {
-    char searchStr[64];
-    snprintf(searchStr, sizeof(searchStr), "\"%s\"", key);
+// Start timer-driven row scanning
+// The timer must already be initialized with its counter at
+// SCAN_TIMER_CLOCK_HZ; ARR sets the row slot, CCR1 ends the on-time.
+bool ArrayDriver::startScan(TIM_HandleTypeDef* htim, uint16_t refreshHz, uint8_t dutyPercent) {
+    if (!htim || refreshHz == 0 || dutyPercent == 0 || dutyPercent > 100) {
+        return false;
+    }
     
-    const char* keyPos = strstr(json, searchStr);
-    if (!keyPos) return nullptr;
+    uint32_t rowTicks = SCAN_TIMER_CLOCK_HZ / ((uint32_t)refreshHz * NUM_ROWS);
+    if (rowTicks < SCAN_MIN_ROW_TICKS || rowTicks > SCAN_MAX_ROW_TICKS) {
+        return false;  // Refresh rate out of range for the timer
+    }
     
-    // Find the colon after the key
-    const char* colon = strchr(keyPos, ':');
-    if (!colon) return nullptr;
+    // A sequence step from the timer ISR must not land between building the
+    // tables and the switch to scanning
+    CriticalSection lock;
     
-    // Skip whitespace after colon
-    colon++;
-    while (*colon && isspace(*colon)) colon++;
+    // Restarting: keep the lines released instead of falling back to static drive
+    if (scanActive) {
+        haltScanTimer();
+    }
     
-    return colon;
-}
-
-// Parse integer from JSON
-int ArrayDriver::parseJSONInt(const char* str) {
-    if (!str) return 0;
+    ElectrodeFrame_t blank;
+    frameClear(&blank);
+    compileFrame(&blank, scanBlankBsrr);
     
-    // Skip whitespace
-    while (*str && isspace(*str)) str++;
+    buildScanTables(scanTables[0]);
+    scanActiveTable = 0;
+    scanSwapPending = false;
+    scanRow = 0;
+    scanDutyPercent = dutyPercent;
+    scanRowTicks = rowTicks;
+    scanTimer = htim;
     
-    // Parse number
-    int value = 0;
-    bool negative = false;
+    // All lines idle until the first row slot
+    writePortMasks(scanBlankBsrr);
+    scanActive = true;
     
-    if (*str == '-') {
-        negative = true;
-        str++;
+    __HAL_TIM_SET_COUNTER(htim, 0);
+    __HAL_TIM_SET_AUTORELOAD(htim, rowTicks - 1U);
+    if (dutyPercent < 100) {
+        __HAL_TIM_SET_COMPARE(htim, TIM_CHANNEL_1, (rowTicks * dutyPercent) / 100U);
+        HAL_TIM_OC_Start_IT(htim, TIM_CHANNEL_1);
     }
+    HAL_TIM_Base_Start_IT(htim);
     
-    while (*str && isdigit(*str)) {
-        value = value * 10 + (*str - '0');
-        str++;
+    return true;
+}
+
+// Stop scanning and return to static row/column drive of the current frame
+void ArrayDriver::stopScan() {
+    CriticalSection lock;
+    if (!scanActive) {
+        return;
     }
     
-    return negative ? -value : value;
+    haltScanTimer();
+    driveFrame();
 }
 
-// Load ElectrodeMap.json - electrode number to PCIE pin
-bool ArrayDriver::loadElectrodeMap(const char* filepath) {
-    size_t fileSize;
-    char* jsonData = readFile(filepath, &fileSize);
-    if (!jsonData) {
-        return false;
+// Stop the scan timer interrupts and mark the engine idle
+void ArrayDriver::haltScanTimer() {
+    HAL_TIM_Base_Stop_IT(scanTimer);
+    if (scanDutyPercent < 100) {
+        HAL_TIM_OC_Stop_IT(scanTimer, TIM_CHANNEL_1);
     }
     
-    bool success = parseElectrodeMapJSON(jsonData);
-    free(jsonData);
-    return success;
+    scanActive = false;
+    scanSwapPending = false;
+    
+    // The ISR left some row slot on the pins
+    drivenLinesValid = false;
+}
+
+// Check if row scanning is active
+bool ArrayDriver::isScanning() {
+    return scanActive;
+}
+
+// Row slot length in timer ticks (0 when not scanning)
+uint32_t ArrayDriver::getScanRowTicks() {
+    return scanActive ? scanRowTicks : 0;
 }
 
-// Parse ElectrodeMap.json
-bool ArrayDriver::parseElectrodeMapJSON(const char* jsonData) {
-    // Find the "mapping" object
-    const char* mappingStart = strstr(jsonData, "\"mapping\"");
-    if (!mappingStart) return false;
+// Row slot start: drive the next row with its column mask
+void ArrayDriver::scanTimerPeriodISR() {
+    if (!scanActive) {
+        return;
+    }
     
-    // Find the opening brace
-    const char* openBrace = strchr(mappingStart, '{');
-    if (!openBrace) return false;
+    if (scanRow == 0 && scanSwapPending) {
+        scanActiveTable ^= 1U;
+        scanSwapPending = false;
+    }
     
-    // Parse each electrode number (1-140)
-    for (uint16_t electrode = 1; electrode <= NUM_ELECTRODES; electrode++) {
-        char keyStr[16];
-        snprintf(keyStr, sizeof(keyStr), "\"%d\"", electrode);
-        
-        const char* keyPos = strstr(openBrace, keyStr);
-        if (keyPos) {
-            const char* valuePos = findJSONValue(keyPos, keyStr + 1); // Remove leading quote
-            if (valuePos) {
-                int pciePin = parseJSONInt(valuePos);
-                // Store the PCIE pin for this electrode
-                // This will be used with PinMap to get row/col
-                if (pciePin > 0 && pciePin <= NUM_ELECTRODES) {
-                    // Temporarily store PCIE pin number
-                    // Will be resolved to row/col when PinMap is loaded
-                    electrodeMap[electrode - 1].row = (pciePin - 1) / NUM_COLS;
-                    electrodeMap[electrode - 1].col = (pciePin - 1) % NUM_COLS;
-                }
-            }
-        }
+    // At 100% duty there is no blanking compare; release the previous row
+    // first so its columns never appear on the new row.
+    if (scanDutyPercent >= 100) {
+        writeScanWord(scanBlankBsrr);
     }
+    writeScanWord(scanTables[scanActiveTable][scanRow]);
     
-    return true;
+    scanRow = (scanRow + 1U >= NUM_ROWS) ? 0 : scanRow + 1U;
 }
 
-// Load PinMap.json - PCIE pin to row/column
-bool ArrayDriver::loadPinMap(const char* filepath) {
-    size_t fileSize;
-    char* jsonData = readFile(filepath, &fileSize);
-    if (!jsonData) {
-        return false;
+// Row slot on-time elapsed: release all lines until the next slot
+void ArrayDriver::scanTimerCompareISR() {
+    if (!scanActive) {
+        return;
     }
     
-    bool success = parsePinMapJSON(jsonData);
-    free(jsonData);
-    return success;
+    writeScanWord(scanBlankBsrr);
 }
 
-// Parse PinMap.json
-bool ArrayDriver::parsePinMapJSON(const char* jsonData) {
-    // Find the "electrodes" object
-    const char* electrodesStart = strstr(jsonData, "\"electrodes\"");
-    if (!electrodesStart) return false;
-    
-    // Find the opening brace
-    const char* openBrace = strchr(electrodesStart, '{');
-    if (!openBrace) return false;
-    
-    // Initialize PCIE to row/col mapping
-    for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
-        pcieToRow[i] = 0;
-        pcieToCol[i] = 0;
+// Benchmark: setElectrode() per position vs. one per-port BSRR mask write
+// Both paths drive the same pattern; the array is left in that pattern.
+// Each setElectrode() call is a delta write of its own row and column.
+void ArrayDriver::benchmarkPatternWrite(const ElectrodeFrame_t* frame, PatternBenchmark_t* result) {
+    if (!frame || !result) {
+        return;
     }
     
-    // Parse each row,col pair from JSON
+    cycleCounterStart();
+    
+    // Per-electrode API: setElectrode() for every position
+    uint32_t start = cycleCounterRead();
     for (uint8_t row = 0; row < NUM_ROWS; row++) {
         for (uint8_t col = 0; col < NUM_COLS; col++) {
-            char keyStr[16];
-            snprintf(keyStr, sizeof(keyStr), "\"%d,%d\"", row, col);
-            
-            const char* keyPos = strstr(openBrace, keyStr);
-            if (keyPos) {
-                // Find the value (PCIE pin number)
-                const char* colon = strchr(keyPos, ':');
-                if (colon) {
-                    int pciePin = parseJSONInt(colon + 1);
-                    if (pciePin > 0 && pciePin <= NUM_ELECTRODES) {
-                        pcieToRow[pciePin - 1] = row;
-                        pcieToCol[pciePin - 1] = col;
-                    }
-                }
-            }
+            setElectrode(row, col, frameGet(frame, row, col));
         }
     }
+    result->loopCycles = cycleCounterRead() - start;
     
-    // Now update electrodeMap with the final mapping
-    // Electrode# → PCIE Pin (from ElectrodeMap.json) → Row/Col (from PinMap.json)
-    for (uint16_t electrode = 1; electrode <= NUM_ELECTRODES; electrode++) {
-        // Get PCIE pin for this electrode (currently stored as temp row/col)
-        uint8_t tempRow = electrodeMap[electrode - 1].row;
-        uint8_t tempCol = electrodeMap[electrode - 1].col;
-        uint16_t pciePin = tempRow * NUM_COLS + tempCol + 1;
-        
-        // Get actual row/col from PCIE pin mapping
-        if (pciePin > 0 && pciePin <= NUM_ELECTRODES) {
-            electrodeMap[electrode - 1].row = pcieToRow[pciePin - 1];
-            electrodeMap[electrode - 1].col = pcieToCol[pciePin - 1];
-        }
-    }
+    // Mask path: compile + one store per port
+    uint32_t bsrr[MAX_GPIO_PORTS];
+    start = cycleCounterRead();
+    compileFrame(frame, bsrr);
+    result->portWrites = writePortMasks(bsrr);
+    result->maskCycles = cycleCounterRead() - start;
     
-    return true;
+    setPattern(frame);
+    
+    // Delta path: the same frame with one electrode toggled
+    ElectrodeFrame_t toggled = electrodeState;
+    toggled.rows[0] ^= 1U;
+    start = cycleCounterRead();
+    result->deltaWrites = setPattern(&toggled);
+    result->deltaCycles = cycleCounterRead() - start;
+    
+    setPattern(frame);
 }
 
-// Load PinDef.json - GPIO definitions (currently hardcoded in header)
-bool ArrayDriver::loadPinDef(const char* filepath) {
-    // GPIO definitions are currently hardcoded in the header file
-    // This function is a placeholder for future dynamic GPIO loading
+// DWT profiling counters: CYCCNT plus the 8-bit CPI/EXC/SLEEP/LSU/FOLD
+// event counters (intervals must stay short so they do not wrap)
+typedef struct {
+    uint32_t cycles;
+    uint8_t cpi;
+    uint8_t exc;
+    uint8_t sleep;
+    uint8_t lsu;
+    uint8_t fold;
+} ProfileSnapshot_t;
+
+static inline void profileCountersStart() {
+    cycleCounterStart();
+#ifdef DWT
+    DWT->CTRL |= DWT_CTRL_CPIEVTENA_Msk | DWT_CTRL_EXCEVTENA_Msk | DWT_CTRL_SLEEPEVTENA_Msk |
+                 DWT_CTRL_LSUEVTENA_Msk | DWT_CTRL_FOLDEVTENA_Msk;
+#endif
+}
+
+static inline void profileSnapshot(ProfileSnapshot_t* snap) {
+    snap->cycles = cycleCounterRead();
+#ifdef DWT
+    snap->cpi = (uint8_t)DWT->CPICNT;
+    snap->exc = (uint8_t)DWT->EXCCNT;
+    snap->sleep = (uint8_t)DWT->SLEEPCNT;
+    snap->lsu = (uint8_t)DWT->LSUCNT;
+    snap->fold = (uint8_t)DWT->FOLDCNT;
+#else
+    snap->cpi = snap->exc = snap->sleep = snap->lsu = snap->fold = 0;
+#endif
+}
+
+// Instructions = cycles - stall/exception/sleep/LSU cycles + folded instructions
+static inline uint32_t profileInstructions(const ProfileSnapshot_t* a, const ProfileSnapshot_t* b) {
+    uint32_t stalls = (uint8_t)(b->cpi - a->cpi) + (uint8_t)(b->exc - a->exc) +
+                      (uint8_t)(b->sleep - a->sleep) + (uint8_t)(b->lsu - a->lsu);
+    return (b->cycles - a->cycles) - stalls + (uint8_t)(b->fold - a->fold);
+}
+
+// Benchmark: runtime-indexed vs compile-time setElectrode on electrode (0,0)
+// Each call is measured on its own (on/off toggles from an empty array);
+// the previous pattern is restored afterwards.
+void ArrayDriver::benchmarkElectrodeWrite(ElectrodeWriteBenchmark_t* result) {
+    if (!result) {
+        return;
+    }
+    
+    const uint8_t toggles = 16;
+    ElectrodeFrame_t saved = electrodeState;
+    ElectrodeFrame_t empty;
+    frameClear(&empty);
+    setPattern(&empty);
+    profileCountersStart();
+    
+    ProfileSnapshot_t before, after;
+    uint32_t cycles = 0;
+    uint32_t instructions = 0;
+    for (uint8_t i = 0; i < toggles; i++) {
+        profileSnapshot(&before);
+        setElectrode(0, 0, (i & 1U) == 0);
+        profileSnapshot(&after);
+        cycles += after.cycles - before.cycles;
+        instructions += profileInstructions(&before, &after);
+    }
+    result->runtimeCycles = cycles / toggles;
+    result->runtimeInstructions = instructions / toggles;
+    
+    cycles = 0;
+    instructions = 0;
+    for (uint8_t i = 0; i < toggles; i++) {
+        profileSnapshot(&before);
+        setElectrodeFixed<0, 0>((i & 1U) == 0);
+        profileSnapshot(&after);
+        cycles += after.cycles - before.cycles;
+        instructions += profileInstructions(&before, &after);
+    }
+    result->fixedCycles = cycles / toggles;
+    result->fixedInstructions = instructions / toggles;
+    
+    setPattern(&saved);
+}
+
+// Generated ElectrodeMap.json-style document for benchmarkMappingParse()
+typedef struct {
+    uint16_t entries;
+    uint16_t next;          // Next electrode to write (0: document header)
+    bool done;
+} MapGenerator_t;
+
+// JsonReadFn producing the generated document a chunk at a time
+static size_t generateMapChunk(char* buffer, size_t size, void* context) {
+    MapGenerator_t* gen = (MapGenerator_t*)context;
+    size_t used = 0;
+    
+    if (gen->next == 0) {
+        used = snprintf(buffer, size, "{\n  \"description\": \"Generated benchmark map\",\n  \"mapping\": {\n");
+        gen->next = 1;
+    }
+    while (gen->next <= gen->entries && size - used > 24) {
+        used += snprintf(buffer + used, size - used, "    \"%u\": %u%s\n", gen->next,
+                         (gen->next - 1U) % NUM_ELECTRODES + 1U, (gen->next < gen->entries) ? "," : "");
+        gen->next++;
+    }
+    if (gen->next > gen->entries && !gen->done && size - used > 8) {
+        used += snprintf(buffer + used, size - used, "  }\n}\n");
+        gen->done = true;
+    }
+    return used;
+}
+
+// Benchmark: mapping parse time against document size
+// The generator runs once on its own so its cost can be taken out of the
+// parse measurement.
+void ArrayDriver::benchmarkMappingParse(uint16_t entries, MappingParseBenchmark_t* result) {
+    if (!result) {
+        return;
+    }
+    
+    char buffer[JSON_CHUNK_SIZE];
+    MapGenerator_t gen = {entries, 0, false};
+    cycleCounterStart();
+    
+    uint32_t bytes = 0;
+    uint32_t start = cycleCounterRead();
+    size_t length;
+    while ((length = generateMapChunk(buffer, sizeof(buffer), &gen)) > 0) {
+        bytes += length;
+    }
+    uint32_t generateCycles = cycleCounterRead() - start;
+    
+    uint8_t scratch[NUM_ELECTRODES];
+    MappingReport_t report;
+    memset(scratch, 0, sizeof(scratch));
+    memset(&report, 0, sizeof(report));
+    JsonTokenizer json;
+    gen = {entries, 0, false};
+    json.begin(generateMapChunk, &gen);
+    start = cycleCounterRead();
+    result->valid = parseElectrodeMap(&json, scratch, &report);
+    uint32_t totalCycles = cycleCounterRead() - start;
+    
+    result->entries = entries;
+    result->bytes = bytes;
+    result->cycles = (totalCycles > generateCycles) ? totalCycles - generateCycles : 0;
+}
+
+// ============================================================================
+// MICROFLUIDICS/PCR TEST SCENARIOS
+// ============================================================================
+
+// Execute sequence synchronously (blocking)
+// Runs the tick engine until the sequence ends: every step starts at its
+// programmed offset from the start of the run, so setup time and tick
+// rounding do not accumulate over long protocols. The loop wakes on every
+// tick, so stopSequence(), pauseSequence() or preemptSequence() called from
+// an interrupt take effect within 1 ms.
+void ArrayDriver::executeSequence(const ElectrodeSequence_t* sequence) {
+    if (!executeSequenceAsync(sequence)) {
+        return;
+    }
+    
+    while (sequenceRunning) {
+        HAL_Delay(0);   // Until the next tick edge
+        CriticalSection lock;
+        updateSequence();
+    }
+}
+
+// Execute sequence asynchronously (non-blocking)
+// The sequence must stay valid until it ends or stopSequence() is called.
+// Returns false (leaving any running sequence alone) for an empty sequence.
+bool ArrayDriver::executeSequenceAsync(const ElectrodeSequence_t* sequence) {
+    if (!sequence || !sequence->steps || sequence->numSteps == 0 || sequence->cycleCount == 0) {
+        return false;
+    }
+    
+    stopSequence();
+    resetSequenceTiming();
+    beginSequence(sequence, nullptr);
     return true;
 }
+
+// Execute sequence from a hardware compare timer (non-blocking)
+// The timer must be a free-running 32-bit timer counting at
+// SEQUENCE_TIMER_CLOCK_HZ; each step deadline is programmed into CCR1 as an
+// absolute count, so step edges land on the microsecond.
+bool ArrayDriver::executeSequenceTimed(TIM_HandleTypeDef* htim, const ElectrodeSequence_t* sequence) {
+    if (!htim || !sequence || !sequence->steps || sequence->numSteps == 0 || sequence->cycleCount == 0) {
+        return false;
+    }
+    
+    stopSequence();
+    resetSequenceTiming();
+    beginSequence(sequence, htim);
+    return true;
+}
+
+// Start a run from its first step on the tick engine (htim == nullptr) or
+// on the step timer
+void ArrayDriver::beginSequence(const ElectrodeSequence_t* sequence, TIM_HandleTypeDef* htim) {
+    currentSequence = const_cast<ElectrodeSequence_t*>(sequence);
+    currentStep = 0;
+    currentCycle = 0;
+    sequencePaused = false;
+    sequenceTimer = htim;
+    
+    if (!htim) {
+        sequenceStartTime = HAL_GetTick();
+        applySequenceStep();
+        stepEnd_us = stepDuration_us;
+        sequenceRunning = true;
+        return;
+    }
+    
+    HAL_TIM_Base_Start(htim);
+    stepDeadline = __HAL_TIM_GET_COUNTER(htim);
+    applySequenceStep();
+    sequenceRunning = true;
+    
+    if (scheduleNextStep()) {
+        HAL_TIM_OC_Start_IT(htim, TIM_CHANNEL_1);
+    }
+}
+
+// Apply the current step and compute how long it is held
+// Same timing as executeSequence(): the cycle delay follows the last step
+// of every cycle but the final one.
+void ArrayDriver::applySequenceStep() {
+    // A reloaded mapping takes over between steps
+    if (pendingMapping) {
+        swapMapping();
+    }
+    
+    const ElectrodeStep_t* step = &currentSequence->steps[currentStep];
+    applyStep(step);
+    
+    uint32_t duration = stepDurationMicros(step);
+    if (currentStep + 1U == currentSequence->numSteps &&
+        currentCycle + 1U < currentSequence->cycleCount) {
+        duration += currentSequence->cycleDelay_ms * 1000U;
+    }
+    stepDuration_us = duration;
+}
+
+// Move to the next step; returns false after the last step of the last
+// cycle (the caller then calls endSequence())
+bool ArrayDriver::advanceSequenceStep() {
+    if (++currentStep >= currentSequence->numSteps) {
+        currentStep = 0;
+        if (++currentCycle >= currentSequence->cycleCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The current run has finished: hand control back to the run it preempted,
+// or stop
+void ArrayDriver::endSequence() {
+    if (preemptDepth == 0) {
+        stopSequence();
+        return;
+    }
+    
+    if (sequenceTimer) {
+        HAL_TIM_OC_Stop_IT(sequenceTimer, TIM_CHANNEL_1);
+    }
+    
+    const SequenceContext_t* context = &preempted[--preemptDepth];
+    currentSequence = context->sequence;
+    currentStep = context->step;
+    currentCycle = context->cycle;
+    stepDuration_us = context->stepDuration_us;
+    sequenceTimer = context->timer;
+    sequencePriority = context->priority;
+    pausedRemaining_us = context->remaining_us;
+    pausedFrame = context->frame;
+    sequencePaused = true;
+    
+    if (!context->paused) {
+        resumeSequence();
+    }
+}
+
+// Program CCR1 with the end of the current step
+// Steps whose end is already due (zero-length, or shorter than the ISR
+// latency) are applied right away. Returns false when the run ended.
+bool ArrayDriver::scheduleNextStep() {
+    while (true) {
+        stepDeadline += stepDuration_us * (SEQUENCE_TIMER_CLOCK_HZ / 1000000U);
+        
+        int32_t lead = (int32_t)(stepDeadline - __HAL_TIM_GET_COUNTER(sequenceTimer));
+        if (lead >= (int32_t)SEQUENCE_MIN_LEAD_TICKS) {
+            __HAL_TIM_SET_COMPARE(sequenceTimer, TIM_CHANNEL_1, stepDeadline);
+            return true;
+        }
+        
+        uint32_t late = (lead < 0) ? (uint32_t)(-lead) / (SEQUENCE_TIMER_CLOCK_HZ / 1000000U) : 0;
+        recordStepEdge(late);
+        if (!advanceSequenceStep()) {
+            endSequence();
+            return false;
+        }
+        applySequenceStep();
+    }
+}
+
+// Step deadline reached: apply the next step and arm the following one
+void ArrayDriver::sequenceTimerISR() {
+    if (!sequenceRunning || !sequenceTimer || sequencePaused) {
+        return;
+    }
+    
+    TIM_HandleTypeDef* htim = sequenceTimer;
+    bool more = advanceSequenceStep();
+    if (more) {
+        applySequenceStep();
+    }
+    
+    // Edge error: GPIO written this long after the programmed time
+    uint32_t late = (__HAL_TIM_GET_COUNTER(htim) - stepDeadline) / (SEQUENCE_TIMER_CLOCK_HZ / 1000000U);
+    recordStepEdge(late);
+    
+    if (more) {
+        scheduleNextStep();
+    } else {
+        endSequence();
+    }
+}
+
+// Clear the edge lateness statistics for a new run
+void ArrayDriver::resetSequenceTiming() {
+    edgeCount = 0;
+    edgeLatencyMax = 0;
+    edgeLatencyLast = 0;
+    edgeLatencySum = 0;
+}
+
+// Account one step edge applied 'late_us' after its deadline
+void ArrayDriver::recordStepEdge(uint32_t late_us) {
+    edgeCount++;
+    edgeLatencySum += late_us;
+    edgeLatencyLast = late_us;
+    if (late_us > edgeLatencyMax) {
+        edgeLatencyMax = late_us;
+    }
+}
+
+// Edge lateness statistics of the last run
+void ArrayDriver::getSequenceTiming(SequenceTiming_t* timing) {
+    if (!timing) {
+        return;
+    }
+    
+    timing->edges = edgeCount;
+    timing->maxLatency_us = edgeLatencyMax;
+    timing->avgLatency_us = edgeCount ? (uint32_t)(edgeLatencySum / edgeCount) : 0;
+    timing->endDrift_us = edgeLatencyLast;
+}
+
+// Advance the asynchronous sequence
+// Applies every step whose start time has passed (zero-duration steps are
+// applied in the same call) and ends the run after the last step. Step
+// ends are offsets from the run start, so a late call delays one edge but
+// not the rest of the run. Timer-driven runs are advanced by
+// sequenceTimerISR() instead.
+void ArrayDriver::updateSequence() {
+    if (!sequenceRunning || sequenceTimer || sequencePaused) {
+        return;
+    }
+    
+    uint64_t elapsed_us = (uint64_t)(HAL_GetTick() - sequenceStartTime) * 1000U;
+    while (elapsed_us >= stepEnd_us) {
+        recordStepEdge((uint32_t)(elapsed_us - stepEnd_us));
+        
+        if (!advanceSequenceStep()) {
+            endSequence();
+            return;
+        }
+        applySequenceStep();
+        stepEnd_us += stepDuration_us;
+    }
+}
+
+// Time left in the current step, from the running engine
+uint32_t ArrayDriver::stepRemainingMicros() {
+    if (sequencePaused) {
+        return pausedRemaining_us;
+    }
+    
+    if (sequenceTimer) {
+        // stepDeadline holds the end of the current step once it is armed
+        int32_t lead = (int32_t)(stepDeadline - __HAL_TIM_GET_COUNTER(sequenceTimer));
+        return (lead > 0) ? (uint32_t)lead / (SEQUENCE_TIMER_CLOCK_HZ / 1000000U) : 0;
+    }
+    
+    uint64_t elapsed_us = (uint64_t)(HAL_GetTick() - sequenceStartTime) * 1000U;
+    return (elapsed_us < stepEnd_us) ? (uint32_t)(stepEnd_us - elapsed_us) : 0;
+}
+
+// Report progress of the asynchronous sequence
+void ArrayDriver::getSequenceProgress(SequenceProgress_t* progress) {
+    if (!progress) {
+        return;
+    }
+    
+    memset(progress, 0, sizeof(SequenceProgress_t));
+    const ElectrodeSequence_t* sequence = currentSequence;
+    if (!sequenceRunning || !sequence) {
+        return;
+    }
+    
+    progress->running = true;
+    progress->paused = sequencePaused;
+    progress->preempted = preemptDepth;
+    progress->priority = sequencePriority;
+    progress->cycle = currentCycle;
+    progress->cycleCount = sequence->cycleCount;
+    progress->step = currentStep;
+    progress->numSteps = sequence->numSteps;
+    
+    uint64_t stepRemaining = stepRemainingMicros();
+    progress->stepRemaining_ms = (uint32_t)(stepRemaining / 1000U);
+    
+    // Rest of this cycle, then the remaining full cycles (with their delays)
+    uint64_t remaining = stepRemaining;
+    uint64_t cycleTime = 0;
+    for (uint16_t i = 0; i < sequence->numSteps; i++) {
+        cycleTime += stepDurationMicros(&sequence->steps[i]);
+        if (i > currentStep) {
+            remaining += stepDurationMicros(&sequence->steps[i]);
+        }
+    }
+    uint64_t cycleDelay = (uint64_t)sequence->cycleDelay_ms * 1000U;
+    if (currentStep + 1U < sequence->numSteps && currentCycle + 1U < sequence->cycleCount) {
+        remaining += cycleDelay;
+    }
+    uint32_t cyclesLeft = sequence->cycleCount - currentCycle - 1U;
+    remaining += (uint64_t)cyclesLeft * cycleTime;
+    if (cyclesLeft > 0) {
+        remaining += (uint64_t)(cyclesLeft - 1U) * cycleDelay;
+    }
+    remaining /= 1000U;
+    progress->totalRemaining_ms = (remaining > UINT32_MAX) ? UINT32_MAX : (uint32_t)remaining;
+}
+
+// Check if sequence is running
+bool ArrayDriver::isSequenceRunning() {
+    return sequenceRunning;
+}
+
+// Stop current sequence, and any sequence it preempted
+void ArrayDriver::stopSequence() {
+    if (sequenceTimer) {
+        HAL_TIM_OC_Stop_IT(sequenceTimer, TIM_CHANNEL_1);
+        sequenceTimer = nullptr;
+    }
+    
+    sequenceRunning = false;
+    sequencePaused = false;
+    sequencePriority = 0;
+    preemptDepth = 0;
+    currentSequence = nullptr;
+    currentStep = 0;
+    currentCycle = 0;
+    
+    // No step edge will come for a pending mapping swap
+    if (pendingMapping) {
+        swapMapping();
+    }
+}
+
+// Freeze the running sequence in its current step
+// The rest of the step is kept to the microsecond (timer engine) or to the
+// tick (tick engine); outputs are left as they are.
+bool ArrayDriver::pauseSequence() {
+    CriticalSection lock;
+    if (!sequenceRunning || sequencePaused) {
+        return false;
+    }
+    
+    pausedRemaining_us = stepRemainingMicros();
+    if (sequenceTimer) {
+        HAL_TIM_OC_Stop_IT(sequenceTimer, TIM_CHANNEL_1);
+    }
+    getPattern(&pausedFrame);
+    sequencePaused = true;
+    
+    if (pendingMapping) {
+        swapMapping();
+    }
+    return true;
+}
+
+// Continue a paused sequence
+// Restores the outputs from the moment of the pause, then holds the step
+// for the time it had left; later steps keep their programmed durations.
+bool ArrayDriver::resumeSequence() {
+    CriticalSection lock;
+    if (!sequenceRunning || !sequencePaused) {
+        return false;
+    }
+    
+    setPattern(&pausedFrame);
+    sequencePaused = false;
+    
+    if (sequenceTimer) {
+        // scheduleNextStep() adds the step duration to the step start
+        uint32_t ticksPerUs = SEQUENCE_TIMER_CLOCK_HZ / 1000000U;
+        stepDeadline = __HAL_TIM_GET_COUNTER(sequenceTimer) +
+                       (pausedRemaining_us - stepDuration_us) * ticksPerUs;
+        if (scheduleNextStep()) {
+            HAL_TIM_OC_Start_IT(sequenceTimer, TIM_CHANNEL_1);
+        }
+    } else {
+        sequenceStartTime = HAL_GetTick();
+        stepEnd_us = pausedRemaining_us;
+    }
+    return true;
+}
+
+// Check if the sequence is paused
+bool ArrayDriver::isSequencePaused() {
+    return sequencePaused;
+}
+
+// Interrupt the running sequence with a more urgent one
+// The interrupted run is paused and saved; when the urgent sequence ends it
+// resumes from the same step with the same time left (or stays paused if it
+// was paused before). Runs on the engine of the interrupted sequence.
+bool ArrayDriver::preemptSequence(const ElectrodeSequence_t* sequence, uint8_t priority) {
+    if (!sequence || !sequence->steps || sequence->numSteps == 0 || sequence->cycleCount == 0) {
+        return false;
+    }
+    
+    CriticalSection lock;
+    if (!sequenceRunning) {
+        stopSequence();
+        resetSequenceTiming();
+        sequencePriority = priority;
+        beginSequence(sequence, nullptr);
+        return true;
+    }
+    if (priority <= sequencePriority || preemptDepth >= SEQUENCE_PREEMPT_DEPTH) {
+        return false;
+    }
+    // The saved context keeps a pointer to the interrupted sequence
+    if (isSequenceInUse(sequence)) {
+        return false;
+    }
+    
+    bool wasPaused = sequencePaused;
+    pauseSequence();
+    
+    SequenceContext_t* context = &preempted[preemptDepth++];
+    context->sequence = currentSequence;
+    context->step = currentStep;
+    context->cycle = currentCycle;
+    context->stepDuration_us = stepDuration_us;
+    context->remaining_us = pausedRemaining_us;
+    context->frame = pausedFrame;
+    context->timer = sequenceTimer;
+    context->priority = sequencePriority;
+    context->paused = wasPaused;
+    
+    sequencePriority = priority;
+    beginSequence(sequence, sequenceTimer);
+    return true;
+}
+
+// Check whether a sequence is running or saved by a preemption
+bool ArrayDriver::isSequenceInUse(const ElectrodeSequence_t* sequence) {
+    CriticalSection lock;
+    if (!sequenceRunning) {
+        return false;
+    }
+    if (currentSequence == sequence) {
+        return true;
+    }
+    for (uint8_t i = 0; i < preemptDepth; i++) {
+        if (preempted[i].sequence == sequence) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// TEST SCENARIOS - User provides custom electrode sequences
+// ============================================================================
+
+// Run a test sequence on specified electrodes (by number 1-140)
+void ArrayDriver::runElectrodeSequenceTest(uint8_t* electrodeNumbers, uint16_t numElectrodes, uint32_t duration_ms) {
+    for (uint16_t i = 0; i < numElectrodes; i++) {
+        setElectrodeHighByNumber(electrodeNumbers[i]);
+        HAL_Delay(duration_ms);
+        setElectrodeLowByNumber(electrodeNumbers[i]);
+    }
+}
+
+// Sequential test of all electrodes (1-140)
+void ArrayDriver::runElectrodeTest() {
+    for (uint8_t electrodeNum = 1; electrodeNum <= NUM_ELECTRODES; electrodeNum++) {
+        setElectrodeHighByNumber(electrodeNum);
+        HAL_Delay(100);  // 100ms per electrode
+        setElectrodeLowByNumber(electrodeNum);
+    }
+}
+
+// ============================================================================
+// MAPPING IMAGE
+// ============================================================================
+
+// Use a compiled mapping image, copied into RAM or in place
+bool ArrayDriver::loadMappingImage(const MappingImage_t* image, bool inPlace) {
+    if (!image || !isMappingImageValid(image) || !applyImageLines(image)) {
+        return false;
+    }
+    
+    pendingMapping = nullptr;
+    if (inPlace) {
+        mapping = image;
+        mappingSource = MAPPING_SOURCE_IMAGE_IN_PLACE;
+    } else {
+        MappingImage_t* tables = shadowTables();
+        if (image != tables) {
+            memcpy(tables, image, sizeof(MappingImage_t));
+        }
+        mapping = tables;
+        mappingSource = MAPPING_SOURCE_IMAGE;
+    }
+    
+    memset(&mappingReport, 0, sizeof(mappingReport));
+    checkMapping(mapping, &mappingReport);
+    mappingReport.source = mappingSource;
+    return true;
+}
+
+// Read a compiled image file (resources/Mapping.bin)
+// The file is read straight into the shadow tables, so the image is used
+// without another copy
+bool ArrayDriver::loadMappingImageFile(const char* filepath) {
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        return false;
+    }
+    
+    MappingImage_t* tables = shadowTables();
+    size_t length = fread(tables, 1, sizeof(MappingImage_t), file);
+    bool extra = fgetc(file) != EOF;
+    fclose(file);
+    
+    return length == sizeof(MappingImage_t) && !extra && loadMappingImage(tables, false);
+}
+
+// Check the header, CRC and table ranges of an image
+bool ArrayDriver::isMappingImageValid(const MappingImage_t* image) {
+    const MappingImageHeader_t* header = &image->header;
+    if (header->magic != MAPPING_IMAGE_MAGIC || header->version != MAPPING_IMAGE_VERSION ||
+        header->size != sizeof(MappingImage_t) || header->rows != NUM_ROWS ||
+        header->cols != NUM_COLS || header->electrodes != NUM_ELECTRODES) {
+        return false;
+    }
+    
+    const uint8_t* tables = (const uint8_t*)image + sizeof(MappingImageHeader_t);
+    if (crc32Update(0, tables, sizeof(MappingImage_t) - sizeof(MappingImageHeader_t)) != header->crc) {
+        return false;
+    }
+    
+    // Rows and columns index the frame words directly; unmapped entries
+    // are marked in both
+    for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
+        const ElectrodeMapping_t* cells[2] = { &image->electrodes[i], &image->pcieToCell[i] };
+        for (uint8_t j = 0; j < 2; j++) {
+            bool unmapped = cells[j]->row == MAPPING_UNMAPPED && cells[j]->col == MAPPING_UNMAPPED;
+            if (!unmapped && (cells[j]->row >= NUM_ROWS || cells[j]->col >= NUM_COLS)) {
+                return false;
+            }
+        }
+        if (image->electrodeToPcie[i] > NUM_ELECTRODES) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fill in the header and CRC of an image
+void ArrayDriver::sealMappingImage(MappingImage_t* image) {
+    image->header.magic = MAPPING_IMAGE_MAGIC;
+    image->header.version = MAPPING_IMAGE_VERSION;
+    image->header.size = sizeof(MappingImage_t);
+    image->header.rows = NUM_ROWS;
+    image->header.cols = NUM_COLS;
+    image->header.electrodes = NUM_ELECTRODES;
+    image->header.reserved = 0;
+    
+    const uint8_t* tables = (const uint8_t*)image + sizeof(MappingImageHeader_t);
+    image->header.crc = crc32Update(0, tables, sizeof(MappingImage_t) - sizeof(MappingImageHeader_t));
+}
+
+// Take over the GPIO lines of an image
+bool ArrayDriver::applyImageLines(const MappingImage_t* image) {
+#ifdef ARRAY_STATIC_PIN_LAYOUT
+    (void)image;
+    return true;  // Layout fixed at build time
+#else
+    GPIO_Pin_t rows[NUM_ROWS];
+    GPIO_Pin_t cols[NUM_COLS];
+    for (uint8_t i = 0; i < NUM_ROWS + NUM_COLS; i++) {
+        const MappingLine_t* line = (i < NUM_ROWS) ? &image->rowLines[i] : &image->colLines[i - NUM_ROWS];
+        GPIO_Pin_t* pin = (i < NUM_ROWS) ? &rows[i] : &cols[i - NUM_ROWS];
+        pin->port = portFromIndex(line->port);
+        if (!pin->port || line->pin > 15) {
+            return false;
+        }
+        pin->pin = (uint16_t)(1U << line->pin);
+    }
+    return applyPinLayout(rows, cols);
+#endif
+}
+
+// Mapping in use as a sealed image
+void ArrayDriver::getMappingImage(MappingImage_t* image) {
+    memcpy(image, mapping, sizeof(MappingImage_t));
+}
+
+// Where the mapping in use came from
+MappingSource_t ArrayDriver::getMappingSource() {
+    return mappingSource;
+}
+
+// Check of the mapping in use
+void ArrayDriver::getMappingReport(MappingReport_t* report) {
+    CriticalSection lock;
+    *report = mappingReport;
+}
+
+// Count the gaps and collisions of the electrode -> PCIE pin -> cell chain
+// One pass over each table with a use count per PCIE pin and per cell
+// (saturating at 2), so the check costs the same for any file contents.
+// Parse counts and the source in 'report' are left as they are.
+void ArrayDriver::checkMapping(const MappingImage_t* tables, MappingReport_t* report) {
+    uint32_t start = cycleCounterRead();
+    
+    // Bits 0-1: electrodes on the PCIE pin or cell; bit 7: cell has a PCIE pin
+    const uint8_t PIN_MAPPED_TO_CELL = 0x80;
+    uint8_t pinUse[NUM_ELECTRODES];
+    uint8_t cellUse[NUM_ELECTRODES];
+    memset(pinUse, 0, sizeof(pinUse));
+    memset(cellUse, 0, sizeof(cellUse));
+    
+    report->electrodesUnmapped = 0;
+    report->pcieShared = 0;
+    report->pcieUnmapped = 0;
+    report->cellsUnassigned = 0;
+    report->electrodesUnresolved = 0;
+    report->cellsShared = 0;
+    report->cellsUnused = 0;
+    report->firstElectrodeUnmapped = 0;
+    report->firstPcieShared = 0;
+    report->firstPcieUnmapped = 0;
+    report->firstCellUnassigned = 0;
+    report->firstElectrodeUnresolved = 0;
+    report->firstCellShared = 0;
+    report->firstCellUnused = 0;
+    
+    for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
+        uint8_t number = (uint8_t)(i + 1);
+        
+        uint8_t pciePin = tables->electrodeToPcie[i];
+        if (pciePin == 0) {
+            if (report->electrodesUnmapped++ == 0) report->firstElectrodeUnmapped = number;
+        } else if (pinUse[pciePin - 1] < 2) {
+            pinUse[pciePin - 1]++;
+        }
+        
+        const ElectrodeMapping_t* cell = &tables->electrodes[i];
+        if (cell->row == MAPPING_UNMAPPED) {
+            if (report->electrodesUnresolved++ == 0) report->firstElectrodeUnresolved = number;
+        } else if ((cellUse[cell->row * NUM_COLS + cell->col] & 0x03) < 2) {
+            cellUse[cell->row * NUM_COLS + cell->col]++;
+        }
+        
+        const ElectrodeMapping_t* pinCell = &tables->pcieToCell[i];
+        if (pinCell->row == MAPPING_UNMAPPED) {
+            if (report->pcieUnmapped++ == 0) report->firstPcieUnmapped = number;
+        } else {
+            cellUse[pinCell->row * NUM_COLS + pinCell->col] |= PIN_MAPPED_TO_CELL;
+        }
+    }
+    
+    for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
+        uint8_t number = (uint8_t)(i + 1);   // PCIE pin, or cell index + 1
+        if (pinUse[i] > 1) {
+            if (report->pcieShared++ == 0) report->firstPcieShared = number;
+        }
+        if (!(cellUse[i] & PIN_MAPPED_TO_CELL)) {
+            if (report->cellsUnassigned++ == 0) report->firstCellUnassigned = number;
+        }
+        uint8_t electrodes = cellUse[i] & 0x03;
+        if (electrodes > 1) {
+            if (report->cellsShared++ == 0) report->firstCellShared = number;
+        } else if (electrodes == 0) {
+            if (report->cellsUnused++ == 0) report->firstCellUnused = number;
+        }
+    }
+    
+    report->bijective = report->electrodesUnresolved == 0 && report->cellsShared == 0;
+    report->problems = report->electrodeEntriesIgnored + report->electrodeDuplicates +
+                       report->pinEntriesIgnored + report->pinDuplicates +
+                       report->electrodesUnmapped + report->pcieShared +
+                       report->pcieUnmapped + report->cellsUnassigned +
+                       report->electrodesUnresolved + report->cellsShared + report->cellsUnused;
+    report->checkCycles = cycleCounterRead() - start;
+}
+
+// RAM tables not in use (loads and reloads are built here)
+MappingImage_t* ArrayDriver::shadowTables() {
+    return (mapping == &mappingTables[0]) ? &mappingTables[1] : &mappingTables[0];
+}
+
+// Install the reloaded tables: a single pointer store, so lookups see
+// either the old or the new mapping as a whole
+void ArrayDriver::swapMapping() {
+    uint32_t start = cycleCounterRead();
+    mapping = pendingMapping;
+    pendingMapping = nullptr;
+    lastReload.swapCycles = cycleCounterRead() - start;
+    lastReload.swapPending = false;
+    mappingSource = MAPPING_SOURCE_JSON;
+    mappingReport = lastReload.check;
+}
+
+// Default reload yield: keep the tick-driven sequence engine on schedule
+void ArrayDriver::serviceSequence(void* context) {
+    ArrayDriver* driver = (ArrayDriver*)context;
+    CriticalSection lock;
+    driver->updateSequence();
+}
+
+// Reload the mapping files into the shadow tables and swap them in
+MappingReloadError_t ArrayDriver::reloadMapping(MappingReload_t* report, JsonYieldFn yield,
+                                                void* yieldContext) {
+    if (pendingMapping) {
+        return MAPPING_RELOAD_ERR_BUSY;
+    }
+    if (!yield) {
+        yield = serviceSequence;
+        yieldContext = this;
+    }
+    
+    cycleCounterStart();
+    uint32_t startTick = HAL_GetTick();
+    uint32_t startCycles = cycleCounterRead();
+    
+    MappingImage_t* tables = shadowTables();
+    uint32_t bytes;
+    MappingReport_t check;
+    MappingReloadError_t error = buildMappingTables(tables, ELECTRODE_MAP_PATH, PIN_MAP_PATH,
+                                                    yield, yieldContext, &bytes, &check);
+    
+    // The GPIO lines stay as configured by init()
+    memcpy(tables->rowLines, mapping->rowLines, sizeof(tables->rowLines));
+    memcpy(tables->colLines, mapping->colLines, sizeof(tables->colLines));
+    sealMappingImage(tables);
+    check.source = MAPPING_SOURCE_JSON;
+    if (error == MAPPING_RELOAD_OK) {
+        // A running system never switches to a partial mapping
+        checkMapping(tables, &check);
+        if (!check.bijective || !isMappingImageValid(tables)) {
+            error = MAPPING_RELOAD_ERR_INVALID;
+        }
+    }
+    check.loadError = error;
+    
+    lastReload.check = check;
+    lastReload.bytes = bytes;
+    lastReload.parseCycles = cycleCounterRead() - startCycles;
+    lastReload.parse_ms = HAL_GetTick() - startTick;
+    lastReload.swapCycles = 0;
+    lastReload.swapPending = false;
+    
+    if (error == MAPPING_RELOAD_OK) {
+        CriticalSection lock;
+        pendingMapping = tables;
+        lastReload.swapPending = true;
+        if (!sequenceRunning || sequencePaused) {
+            swapMapping();
+        }
+    }
+    
+    if (report) {
+        *report = lastReload;
+    }
+    return error;
+}
+
+// Cost of the last reload; swapPending clears once the tables are in use
+void ArrayDriver::getMappingReload(MappingReload_t* report) {
+    CriticalSection lock;
+    *report = lastReload;
+}
+
+// GPIO port of an image port index (nullptr if the device has no such port)
+GPIO_TypeDef* ArrayDriver::portFromIndex(uint8_t index) {
+    switch (index) {
+        case 0: return GPIOA;
+        case 1: return GPIOB;
+        case 2: return GPIOC;
+        case 3: return GPIOD;
+#ifdef GPIOE
+        case 4: return GPIOE;
+#endif
+        default: return nullptr;
+    }
+}
+
+// Image port index of a GPIO port (0xFF if unknown)
+uint8_t ArrayDriver::portToIndex(GPIO_TypeDef* port) {
+    GPIO_TypeDef* candidate;
+    for (uint8_t i = 0; (candidate = portFromIndex(i)) != nullptr; i++) {
+        if (candidate == port) {
+            return i;
+        }
+    }
+    return 0xFF;
+}
+
+// ============================================================================
+// JSON FILE READING AND PARSING
+// ============================================================================
+
+// Build the RAM image from the JSON chain
+// Electrode# → PCIE pin (ElectrodeMap.json) → row/col (PinMap.json) →
+// GPIO line (PinDef.json, or the header macros)
+bool ArrayDriver::loadMappingJSON(const char* electrodeMapPath, const char* pinMapPath,
+                                  const char* pinDefPath) {
+    MappingImage_t* tables = shadowTables();
+    uint32_t bytes;
+    MappingReport_t report;
+    MappingReloadError_t error = buildMappingTables(tables, electrodeMapPath, pinMapPath,
+                                                    nullptr, nullptr, &bytes, &report);
+    bool success = (error == MAPPING_RELOAD_OK);
+    
+    if (!success) {
+        // Fallback: default 1:1 mapping (electrode n = PCIE pin n)
+        memset(&report, 0, sizeof(report));
+        report.loadError = error;
+        for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
+            tables->electrodeToPcie[i] = (uint8_t)(i + 1);
+            tables->pcieToCell[i].row = i / NUM_COLS;
+            tables->pcieToCell[i].col = i % NUM_COLS;
+            tables->electrodes[i] = tables->pcieToCell[i];
+        }
+    }
+    
+    // PinDef.json overrides the header pin macros when present
+    setMacroPinLayout();
+    loadPinDef(pinDefPath);
+    for (uint8_t i = 0; i < NUM_ROWS + NUM_COLS; i++) {
+        const GPIO_Pin_t* pin = (i < NUM_ROWS) ? &rowPins[i] : &colPins[i - NUM_ROWS];
+        MappingLine_t* line = (i < NUM_ROWS) ? &tables->rowLines[i] : &tables->colLines[i - NUM_ROWS];
+        line->port = portToIndex(pin->port);
+        line->pin = (uint8_t)__builtin_ctz(pin->pin);
+    }
+    
+    sealMappingImage(tables);
+    pendingMapping = nullptr;
+    mapping = tables;
+    mappingSource = success ? MAPPING_SOURCE_JSON : MAPPING_SOURCE_DEFAULT;
+    
+    // Partial maps are used as they are, but reported
+    report.source = mappingSource;
+    checkMapping(tables, &report);
+    mappingReport = report;
+    return success;
+}
+
+// Parse ElectrodeMap.json and PinMap.json into 'tables' and resolve the
+// electrode → row/col table; the GPIO lines and header are left to the caller.
+// Anything the files do not map stays unmapped. Skipped and repeated entries
+// are counted in 'report' (the rest of it is cleared).
+// Files are streamed through the tokenizer's chunk buffer (opened as stdio
+// streams; use a FatFS/LittleFS stdio layer on the target).
+MappingReloadError_t ArrayDriver::buildMappingTables(MappingImage_t* tables, const char* electrodeMapPath,
+                                                     const char* pinMapPath, JsonYieldFn yield,
+                                                     void* yieldContext, uint32_t* bytes,
+                                                     MappingReport_t* report) {
+    memset(tables, 0, sizeof(MappingImage_t));
+    memset(tables->electrodes, MAPPING_UNMAPPED, sizeof(tables->electrodes));
+    memset(tables->pcieToCell, MAPPING_UNMAPPED, sizeof(tables->pcieToCell));
+    memset(report, 0, sizeof(MappingReport_t));
+    *bytes = 0;
+    
+    JsonTokenizer json;
+    bool valid = json.open(electrodeMapPath, yield, yieldContext) &&
+                 parseElectrodeMap(&json, tables->electrodeToPcie, report);
+    *bytes += json.getPosition();
+    json.close();
+    if (!valid) {
+        return MAPPING_RELOAD_ERR_ELECTRODE_MAP;
+    }
+    
+    valid = json.open(pinMapPath, yield, yieldContext) &&
+            parsePinMap(&json, tables->pcieToCell, report);
+    *bytes += json.getPosition();
+    json.close();
+    if (!valid) {
+        return MAPPING_RELOAD_ERR_PIN_MAP;
+    }
+    
+    for (uint16_t i = 0; i < NUM_ELECTRODES; i++) {
+        uint8_t pciePin = tables->electrodeToPcie[i];
+        if (pciePin > 0) {
+            tables->electrodes[i] = tables->pcieToCell[pciePin - 1];
+        }
+    }
+    return MAPPING_RELOAD_OK;
+}
+
+// Parse integer from JSON
+int ArrayDriver::parseJSONInt(const char* str) {
+    if (!str) return 0;
+    
+    // Skip whitespace
+    while (*str && isspace(*str)) str++;
+    
+    // Parse number
+    int value = 0;
+    bool negative = false;
+    
+    if (*str == '-') {
+        negative = true;
+        str++;
+    }
+    
+    while (*str && isdigit(*str)) {
+        value = value * 10 + (*str - '0');
+        str++;
+    }
+    
+    return negative ? -value : value;
+}
+
+// Read the "mapping" object ("<electrode>": <PCIE pin>) into the electrode
+// to PCIE pin table (cleared by the caller). Entries outside 1-140 are
+// ignored, a repeated electrode replaces the earlier entry; both are counted.
+bool ArrayDriver::parseElectrodeMap(JsonTokenizer* json, uint8_t* toPcie, MappingReport_t* report) {
+    JsonToken_t token;
+    JsonStatus_t status;
+    bool inMapping = false;
+    bool found = false;
+    uint32_t electrode = 0;
+    bool keyValid = false;
+    
+    while ((status = json->next(&token)) == JSON_TOKEN) {
+        if (token.depth == 1 && token.type == JSON_KEY) {
+            inMapping = (strcmp(token.text, "mapping") == 0);
+        } else if (inMapping && token.depth == 1 && token.type == JSON_OBJECT_START) {
+            found = true;
+        } else if (inMapping && token.depth == 2 && token.type == JSON_KEY) {
+            keyValid = JsonTokenizer::toUnsigned(&token, &electrode) &&
+                       electrode >= 1 && electrode <= NUM_ELECTRODES;
+        } else if (inMapping && token.depth == 2 &&
+                   token.type != JSON_OBJECT_END && token.type != JSON_ARRAY_END) {
+            uint32_t pciePin;
+            if (!keyValid || token.type != JSON_NUMBER || !JsonTokenizer::toUnsigned(&token, &pciePin) ||
+                pciePin < 1 || pciePin > NUM_ELECTRODES) {
+                report->electrodeEntriesIgnored++;
+            } else {
+                if (toPcie[electrode - 1] != 0) {
+                    report->electrodeDuplicates++;
+                }
+                toPcie[electrode - 1] = (uint8_t)pciePin;
+            }
+        } else if (token.depth == 1 && token.type == JSON_OBJECT_END) {
+            inMapping = false;
+        }
+    }
+    
+    return status == JSON_END && found;
+}
+
+// Read the "electrodes" object ("<row>,<col>": <PCIE pin>) into the PCIE
+// pin to row/col table (unmapped entries marked by the caller). Entries off
+// the matrix are ignored, a PCIE pin given to a second cell keeps the later
+// one; both are counted.
+bool ArrayDriver::parsePinMap(JsonTokenizer* json, ElectrodeMapping_t* pcieMap, MappingReport_t* report) {
+    JsonToken_t token;
+    JsonStatus_t status;
+    bool inElectrodes = false;
+    bool found = false;
+    uint32_t row = 0, col = 0;
+    bool keyValid = false;
+    
+    while ((status = json->next(&token)) == JSON_TOKEN) {
+        if (token.depth == 1 && token.type == JSON_KEY) {
+            inElectrodes = (strcmp(token.text, "electrodes") == 0);
+        } else if (inElectrodes && token.depth == 1 && token.type == JSON_OBJECT_START) {
+            found = true;
+        } else if (inElectrodes && token.depth == 2 && token.type == JSON_KEY) {
+            keyValid = parseRowColKey(&token, &row, &col);
+        } else if (inElectrodes && token.depth == 2 &&
+                   token.type != JSON_OBJECT_END && token.type != JSON_ARRAY_END) {
+            uint32_t pciePin;
+            if (!keyValid || token.type != JSON_NUMBER || !JsonTokenizer::toUnsigned(&token, &pciePin) ||
+                pciePin < 1 || pciePin > NUM_ELECTRODES) {
+                report->pinEntriesIgnored++;
+            } else {
+                if (pcieMap[pciePin - 1].row != MAPPING_UNMAPPED) {
+                    report->pinDuplicates++;
+                }
+                pcieMap[pciePin - 1].row = (uint8_t)row;
+                pcieMap[pciePin - 1].col = (uint8_t)col;
+            }
+        } else if (token.depth == 1 && token.type == JSON_OBJECT_END) {
+            inElectrodes = false;
+        }
+    }
+    
+    return status == JSON_END && found;
+}
+
+// Split a "<row>,<col>" key; false if it is malformed or off the matrix
+bool ArrayDriver::parseRowColKey(const JsonToken_t* key, uint32_t* row, uint32_t* col) {
+    const char* comma = strchr(key->text, ',');
+    if (!comma) {
+        return false;
+    }
+    
+    JsonToken_t part = *key;
+    part.length = (uint16_t)(comma - key->text);
+    if (!JsonTokenizer::toUnsigned(&part, row)) {
+        return false;
+    }
+    part.text = comma + 1;
+    part.length = (uint16_t)(key->length - part.length - 1);
+    if (!JsonTokenizer::toUnsigned(&part, col)) {
+        return false;
+    }
+    return *row < NUM_ROWS && *col < NUM_COLS;
+}
+
+// Load PinDef.json - row/column line to GPIO port/pin
+// On success the line tables and per-port masks are rebuilt; on any error
+// the current layout (header macros by default) is kept.
+bool ArrayDriver::loadPinDef(const char* filepath) {
+#ifdef ARRAY_STATIC_PIN_LAYOUT
+    (void)filepath;
+    return true;  // Layout fixed at build time
+#else
+    JsonTokenizer json;
+    if (!json.open(filepath)) {
+        return false;
+    }
+    
+    bool success = parsePinDefJSON(&json);
+    json.close();
+    return success;
+#endif
+}
+
+// Parse PinDef.json
+bool ArrayDriver::parsePinDefJSON(JsonTokenizer* json) {
+    GPIO_Pin_t rows[NUM_ROWS];
+    GPIO_Pin_t cols[NUM_COLS];
+    
+    if (!parsePinDef(json, rows, cols)) {
+        return false;
+    }
+    return applyPinLayout(rows, cols);
+}
+
+// Row/column lines from the ROWn/COLn header macros
+void ArrayDriver::setMacroPinLayout() {
+    // Initialize row GPIO lookup table
+    rowPins[0] = {ROW0_PORT, ROW0_PIN};
+    rowPins[1] = {ROW1_PORT, ROW1_PIN};
+    rowPins[2] = {ROW2_PORT, ROW2_PIN};
+    rowPins[3] = {ROW3_PORT, ROW3_PIN};
+    rowPins[4] = {ROW4_PORT, ROW4_PIN};
+    rowPins[5] = {ROW5_PORT, ROW5_PIN};
+    rowPins[6] = {ROW6_PORT, ROW6_PIN};
+    rowPins[7] = {ROW7_PORT, ROW7_PIN};
+    rowPins[8] = {ROW8_PORT, ROW8_PIN};
+    rowPins[9] = {ROW9_PORT, ROW9_PIN};
+    
+    // Initialize column GPIO lookup table
+    colPins[0] = {COL0_PORT, COL0_PIN};
+    colPins[1] = {COL1_PORT, COL1_PIN};
+    colPins[2] = {COL2_PORT, COL2_PIN};
+    colPins[3] = {COL3_PORT, COL3_PIN};
+    colPins[4] = {COL4_PORT, COL4_PIN};
+    colPins[5] = {COL5_PORT, COL5_PIN};
+    colPins[6] = {COL6_PORT, COL6_PIN};
+    colPins[7] = {COL7_PORT, COL7_PIN};
+    colPins[8] = {COL8_PORT, COL8_PIN};
+    colPins[9] = {COL9_PORT, COL9_PIN};
+    colPins[10] = {COL10_PORT, COL10_PIN};
+    colPins[11] = {COL11_PORT, COL11_PIN};
+    colPins[12] = {COL12_PORT, COL12_PIN};
+    colPins[13] = {COL13_PORT, COL13_PIN};
+    
+    pinLayoutFromMacros = true;
+    
+    // Group the lines by GPIO port for whole-frame BSRR writes
+    buildPortTables();
+    drivenLinesValid = false;
+}
+
+// Take over a row/column pin layout
+// Every line needs its own pin, and the lines may span at most
+// MAX_GPIO_PORTS ports (one BSRR store per port).
+bool ArrayDriver::applyPinLayout(const GPIO_Pin_t* rows, const GPIO_Pin_t* cols) {
+    GPIO_TypeDef* ports[MAX_GPIO_PORTS];
+    uint16_t used[MAX_GPIO_PORTS] = {0};
+    uint8_t numPorts = 0;
+    for (uint8_t i = 0; i < NUM_ROWS + NUM_COLS; i++) {
+        const GPIO_Pin_t* line = (i < NUM_ROWS) ? &rows[i] : &cols[i - NUM_ROWS];
+        uint8_t p = 0;
+        while (p < numPorts && ports[p] != line->port) p++;
+        if (p == numPorts) {
+            if (numPorts >= MAX_GPIO_PORTS) return false;
+            ports[numPorts++] = line->port;
+        }
+        if (used[p] & line->pin) return false;
+        used[p] |= line->pin;
+    }
+    
+    // Loaded before init(): the pins are configured from these tables
+    memcpy(rowPins, rows, sizeof(rowPins));
+    memcpy(colPins, cols, sizeof(colPins));
+    buildPortTables();
+    pinLayoutFromMacros = pinLayoutMatchesMacros();
+    drivenLinesValid = false;
+    
+    return true;
+}
+
+// Read the "rows" and "cols" objects ("<index>": "P<port><pin>"); every
+// line must be given exactly once with a valid pin name
+bool ArrayDriver::parsePinDef(JsonTokenizer* json, GPIO_Pin_t* rows, GPIO_Pin_t* cols) {
+    JsonToken_t token;
+    JsonStatus_t status;
+    GPIO_Pin_t* lines = nullptr;    // Table of the object being read
+    uint8_t numLines = 0;
+    uint32_t seenRows = 0, seenCols = 0;
+    uint32_t* seen = nullptr;
+    uint32_t index = 0;
+    bool keyValid = false;
+    
+    while ((status = json->next(&token)) == JSON_TOKEN) {
+        if (token.depth == 1 && token.type == JSON_KEY) {
+            bool isRows = (strcmp(token.text, "rows") == 0);
+            bool isCols = (strcmp(token.text, "cols") == 0);
+            lines = isRows ? rows : (isCols ? cols : nullptr);
+            numLines = isRows ? NUM_ROWS : NUM_COLS;
+            seen = isRows ? &seenRows : &seenCols;
+        } else if (lines && token.depth == 2 && token.type == JSON_KEY) {
+            keyValid = JsonTokenizer::toUnsigned(&token, &index) && index < numLines;
+        } else if (lines && token.depth == 2 && keyValid) {
+            if (token.type != JSON_STRING || (*seen & (1UL << index)) ||
+                !parsePinName(token.text, &lines[index])) {
+                return false;
+            }
+            *seen |= (1UL << index);
+        } else if (token.depth == 1 && token.type == JSON_OBJECT_END) {
+            lines = nullptr;
+        }
+    }
+    
+    return status == JSON_END && seenRows == (1UL << NUM_ROWS) - 1U &&
+           seenCols == (1UL << NUM_COLS) - 1U;
+}
+
+// Parse a pin name such as "PA0" or "PD15"
+bool ArrayDriver::parsePinName(const char* str, GPIO_Pin_t* line) {
+    if (str[0] != 'P' || !isdigit(str[2])) {
+        return false;
+    }
+    
+    switch (str[1]) {
+        case 'A': line->port = GPIOA; break;
+        case 'B': line->port = GPIOB; break;
+        case 'C': line->port = GPIOC; break;
+        case 'D': line->port = GPIOD; break;
+#ifdef GPIOE
+        case 'E': line->port = GPIOE; break;
+#endif
+        default: return false;
+    }
+    
+    int pin = parseJSONInt(str + 2);
+    if (pin < 0 || pin > 15 || strlen(str) > (pin < 10 ? 3U : 4U)) {
+        return false;
+    }
+    line->pin = (uint16_t)(1U << pin);
+    
+    return true;
+}
+
+// Compare the line tables with the ROWn/COLn header macros
+bool ArrayDriver::pinLayoutMatchesMacros() {
+    const GPIO_Pin_t macroRows[NUM_ROWS] = {
+        {ROW0_PORT, ROW0_PIN}, {ROW1_PORT, ROW1_PIN}, {ROW2_PORT, ROW2_PIN},
+        {ROW3_PORT, ROW3_PIN}, {ROW4_PORT, ROW4_PIN}, {ROW5_PORT, ROW5_PIN},
+        {ROW6_PORT, ROW6_PIN}, {ROW7_PORT, ROW7_PIN}, {ROW8_PORT, ROW8_PIN},
+        {ROW9_PORT, ROW9_PIN}
+    };
+    const GPIO_Pin_t macroCols[NUM_COLS] = {
+        {COL0_PORT, COL0_PIN}, {COL1_PORT, COL1_PIN}, {COL2_PORT, COL2_PIN},
+        {COL3_PORT, COL3_PIN}, {COL4_PORT, COL4_PIN}, {COL5_PORT, COL5_PIN},
+        {COL6_PORT, COL6_PIN}, {COL7_PORT, COL7_PIN}, {COL8_PORT, COL8_PIN},
+        {COL9_PORT, COL9_PIN}, {COL10_PORT, COL10_PIN}, {COL11_PORT, COL11_PIN},
+        {COL12_PORT, COL12_PIN}, {COL13_PORT, COL13_PIN}
+    };
+    
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        if (rowPins[row].port != macroRows[row].port || rowPins[row].pin != macroRows[row].pin) {
+            return false;
+        }
+    }
+    for (uint8_t col = 0; col < NUM_COLS; col++) {
+        if (colPins[col].port != macroCols[col].port || colPins[col].pin != macroCols[col].pin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check if the pin layout differs from the header macros
+bool ArrayDriver::hasCustomPinLayout() {
+    return !pinLayoutFromMacros;
+}
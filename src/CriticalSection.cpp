@@ -0,0 +1,63 @@
+#include "CriticalSection.h"
+
+uint32_t CriticalSection::maskBasepri =
+    (CRITICAL_SECTION_MASK_PRIORITY << (8U - __NVIC_PRIO_BITS)) & 0xFFU;
+volatile uint8_t CriticalSection::depth = 0;
+volatile uint32_t CriticalSection::enterCycles = 0;
+volatile uint32_t CriticalSection::longestCycles = 0;
+volatile uint32_t CriticalSection::sectionCount = 0;
+
+// Enter: raise BASEPRI to the mask priority (never lower it)
+CriticalSection::CriticalSection() {
+    savedBasepri = __get_BASEPRI();
+    __set_BASEPRI_MAX(maskBasepri);
+    
+    if (depth++ == 0) {
+        enterCycles = cycleCounterRead();
+    }
+}
+
+// Leave: restore the BASEPRI found on entry
+CriticalSection::~CriticalSection() {
+    if (--depth == 0) {
+        uint32_t elapsed = cycleCounterRead() - enterCycles;
+        if (elapsed > longestCycles) {
+            longestCycles = elapsed;
+        }
+        sectionCount++;
+    }
+    
+    __set_BASEPRI(savedBasepri);
+}
+
+// Set the mask priority
+bool CriticalSection::setMaskPriority(uint8_t priority) {
+    if (priority == 0 || priority >= (1U << __NVIC_PRIO_BITS)) {
+        return false;
+    }
+    
+    maskBasepri = ((uint32_t)priority << (8U - __NVIC_PRIO_BITS)) & 0xFFU;
+    return true;
+}
+
+// Get the mask priority
+uint8_t CriticalSection::getMaskPriority() {
+    return (uint8_t)(maskBasepri >> (8U - __NVIC_PRIO_BITS));
+}
+
+// Longest masked interval in CPU cycles
+uint32_t CriticalSection::getLongestCycles() {
+    return longestCycles;
+}
+
+// Number of completed outermost sections
+uint32_t CriticalSection::getSectionCount() {
+    return sectionCount;
+}
+
+// Reset the instrumentation (also starts the cycle counter)
+void CriticalSection::resetStats() {
+    cycleCounterStart();
+    longestCycles = 0;
+    sectionCount = 0;
+}
@@ -0,0 +1,314 @@
+#include "JsonTokenizer.h"
+#include <string.h>
+
+// Constructor
+JsonTokenizer::JsonTokenizer() {
+    file = nullptr;
+    yield = nullptr;
+    yieldContext = nullptr;
+    begin("");
+}
+
+// ============================================================================
+// INPUT
+// ============================================================================
+
+// Start a new document
+void JsonTokenizer::reset() {
+    inputPos = 0;
+    consumed = 0;
+    pending = -1;
+    state = EXPECT_VALUE;
+    depth = 0;
+    objectLevels = 0;
+    textLength = 0;
+    truncated = false;
+    text[0] = '\0';
+}
+
+// Tokenize a string in memory
+void JsonTokenizer::begin(const char* json) {
+    reset();
+    input = json;
+    inputLength = strlen(json);
+    read = nullptr;
+    readContext = nullptr;
+}
+
+// Tokenize from a read callback
+void JsonTokenizer::begin(JsonReadFn readFn, void* context) {
+    reset();
+    input = chunk;
+    inputLength = 0;
+    read = readFn;
+    readContext = context;
+}
+
+// Tokenize a file
+bool JsonTokenizer::open(const char* filepath, JsonYieldFn yieldFn, void* context) {
+    close();
+    file = fopen(filepath, "r");
+    if (!file) {
+        return false;
+    }
+    
+    setvbuf(file, nullptr, _IONBF, 0);  // Reads go straight into 'chunk'
+    begin(readFile, this);
+    yield = yieldFn;
+    yieldContext = context;
+    return true;
+}
+
+// Close the file opened by open()
+void JsonTokenizer::close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+// JsonReadFn for the file opened by open()
+size_t JsonTokenizer::readFile(char* buffer, size_t size, void* context) {
+    JsonTokenizer* self = (JsonTokenizer*)context;
+    size_t length = fread(buffer, 1, size, self->file);
+    if (self->yield) {
+        self->yield(self->yieldContext);
+    }
+    return length;
+}
+
+// Next input character, or -1 at the end of the input
+int JsonTokenizer::nextChar() {
+    if (pending >= 0) {
+        int c = pending;
+        pending = -1;
+        return c;
+    }
+    
+    if (inputPos >= inputLength) {
+        if (!read) {
+            return -1;
+        }
+        inputLength = read(chunk, JSON_CHUNK_SIZE, readContext);
+        inputPos = 0;
+        if (inputLength == 0) {
+            return -1;
+        }
+    }
+    
+    consumed++;
+    return (unsigned char)input[inputPos++];
+}
+
+// Bytes consumed so far
+uint32_t JsonTokenizer::getPosition() {
+    return consumed;
+}
+
+// ============================================================================
+// SCANNING
+// ============================================================================
+
+// Add a character to the token text (cut at JSON_TOKEN_LEN - 1)
+void JsonTokenizer::appendText(char c) {
+    if (textLength + 1U < JSON_TOKEN_LEN) {
+        text[textLength++] = c;
+    } else {
+        truncated = true;
+    }
+}
+
+// Read a string after its opening quote
+bool JsonTokenizer::readString() {
+    while (true) {
+        int c = nextChar();
+        if (c < 0x20) {
+            return false;   // End of input or raw control character
+        }
+        if (c == '"') {
+            return true;
+        }
+        if (c != '\\') {
+            appendText((char)c);
+            continue;
+        }
+        
+        c = nextChar();
+        switch (c) {
+            case '"': case '\\': case '/': appendText((char)c); break;
+            case 'b': appendText('\b'); break;
+            case 'f': appendText('\f'); break;
+            case 'n': appendText('\n'); break;
+            case 'r': appendText('\r'); break;
+            case 't': appendText('\t'); break;
+            case 'u': {
+                // ASCII code points are kept, anything else becomes '?'
+                uint32_t code = 0;
+                for (uint8_t i = 0; i < 4; i++) {
+                    c = nextChar();
+                    if (c >= '0' && c <= '9') code = (code << 4) | (uint32_t)(c - '0');
+                    else if (c >= 'a' && c <= 'f') code = (code << 4) | (uint32_t)(c - 'a' + 10);
+                    else if (c >= 'A' && c <= 'F') code = (code << 4) | (uint32_t)(c - 'A' + 10);
+                    else return false;
+                }
+                appendText((code < 0x80U) ? (char)code : '?');
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+// Read a number or literal starting with 'first'; the character that ends
+// it is kept for the next read
+bool JsonTokenizer::readBareValue(int first, JsonTokenType_t* type) {
+    bool number = (first == '-' || (first >= '0' && first <= '9'));
+    bool word = (first >= 'a' && first <= 'z');
+    if (!number && !word) {
+        return false;
+    }
+    
+    int c = first;
+    while ((number && ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) ||
+           (word && c >= 'a' && c <= 'z')) {
+        appendText((char)c);
+        c = nextChar();
+    }
+    pending = c;
+    text[textLength] = '\0';
+    
+    if (number) {
+        *type = JSON_NUMBER;
+        return text[textLength - 1] >= '0' && text[textLength - 1] <= '9';
+    }
+    *type = JSON_LITERAL;
+    return strcmp(text, "true") == 0 || strcmp(text, "false") == 0 || strcmp(text, "null") == 0;
+}
+
+// Syntax error: every later call fails as well
+JsonStatus_t JsonTokenizer::fail() {
+    state = FAILED;
+    return JSON_ERROR;
+}
+
+// ============================================================================
+// TOKENS
+// ============================================================================
+
+// Next token of the document
+JsonStatus_t JsonTokenizer::next(JsonToken_t* token) {
+    if (state == FAILED) {
+        return JSON_ERROR;
+    }
+    
+    textLength = 0;
+    truncated = false;
+    text[0] = '\0';
+    token->text = text;
+    token->length = 0;
+    token->truncated = false;
+    
+    while (true) {
+        int c = nextChar();
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            continue;
+        }
+        if (c < 0) {
+            return (state == EXPECT_NOTHING) ? JSON_END : fail();
+        }
+        
+        bool inObject = depth > 0 && (objectLevels & (1UL << (depth - 1))) != 0;
+        switch (state) {
+            case EXPECT_COLON:
+                if (c != ':') return fail();
+                state = EXPECT_VALUE;
+                continue;
+            
+            case EXPECT_COMMA_OR_END:
+                if (c == ',') {
+                    state = inObject ? EXPECT_KEY : EXPECT_VALUE;
+                    continue;
+                }
+                if (c != (inObject ? '}' : ']')) return fail();
+                break;
+            
+            case EXPECT_KEY_OR_END:
+                if (c == '}') break;
+                // fall through
+            case EXPECT_KEY:
+                if (c != '"' || !readString()) return fail();
+                text[textLength] = '\0';
+                token->type = JSON_KEY;
+                token->depth = depth;
+                token->length = textLength;
+                token->truncated = truncated;
+                state = EXPECT_COLON;
+                return JSON_TOKEN;
+            
+            case EXPECT_VALUE_OR_END:
+                if (c == ']') break;
+                // fall through
+            case EXPECT_VALUE:
+                if (c == '}' || c == ']') return fail();
+                break;
+            
+            default:    // EXPECT_NOTHING: data after the document
+                return fail();
+        }
+        
+        // Container end (validated above)
+        if (c == '}' || c == ']') {
+            depth--;
+            token->type = (c == '}') ? JSON_OBJECT_END : JSON_ARRAY_END;
+            token->depth = depth;
+            state = (depth == 0) ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+            return JSON_TOKEN;
+        }
+        
+        // Value
+        token->depth = depth;
+        if (c == '{' || c == '[') {
+            if (depth >= JSON_MAX_DEPTH) return fail();
+            if (c == '{') {
+                objectLevels |= (1UL << depth);
+            } else {
+                objectLevels &= ~(1UL << depth);
+            }
+            depth++;
+            token->type = (c == '{') ? JSON_OBJECT_START : JSON_ARRAY_START;
+            state = (c == '{') ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END;
+            return JSON_TOKEN;
+        }
+        
+        if (c == '"') {
+            if (!readString()) return fail();
+            text[textLength] = '\0';
+            token->type = JSON_STRING;
+        } else if (!readBareValue(c, &token->type)) {
+            return fail();
+        }
+        token->length = textLength;
+        token->truncated = truncated;
+        state = (depth == 0) ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+        return JSON_TOKEN;
+    }
+}
+
+// Token text as a decimal number (digits only, up to 999999999)
+bool JsonTokenizer::toUnsigned(const JsonToken_t* token, uint32_t* value) {
+    if (token->length == 0 || token->length > 9 || token->truncated) {
+        return false;
+    }
+    
+    uint32_t number = 0;
+    for (uint16_t i = 0; i < token->length; i++) {
+        char c = token->text[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        number = number * 10U + (uint32_t)(c - '0');
+    }
+    *value = number;
+    return true;
+}
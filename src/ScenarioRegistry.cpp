@@ -0,0 +1,230 @@
+#include "ScenarioRegistry.h"
+
+// Constructor
+ScenarioRegistry::ScenarioRegistry(ArrayDriver* driver) {
+    arrayDriver = driver;
+    memset(scenarios, 0, sizeof(scenarios));
+    numScenarios = 0;
+    skipped = 0;
+    stepsUsed = 0;
+}
+
+// ============================================================================
+// LOADER
+// ============================================================================
+
+// Read and compile a scenario file
+// The file is streamed through the tokenizer's chunk buffer.
+uint8_t ScenarioRegistry::load(const char* filepath) {
+    JsonTokenizer json;
+    if (!json.open(filepath)) {
+        json.begin("");
+        return parse(&json);
+    }
+    
+    uint8_t count = parse(&json);
+    json.close();
+    return count;
+}
+
+// Compile the "scenarios" array of a JSON document
+uint8_t ScenarioRegistry::loadJSON(const char* json) {
+    JsonTokenizer tokenizer;
+    tokenizer.begin(json);
+    return parse(&tokenizer);
+}
+
+// Compile the "scenarios" array from a token stream
+// Token depths: 1 document members, 2 scenario objects, 3 scenario members,
+// 4 step objects, 5 step members, 6 electrode numbers.
+uint8_t ScenarioRegistry::parse(JsonTokenizer* json) {
+    numScenarios = 0;
+    skipped = 0;
+    stepsUsed = 0;
+    
+    JsonToken_t token;
+    bool inScenarios = false;
+    bool inScenario = false;
+    bool inSteps = false;
+    bool inStep = false;
+    bool inElectrodes = false;
+    char scenarioKey[24] = "";
+    char stepKey[24] = "";
+    
+    Scenario_t scenario;
+    bool valid = false;
+    uint16_t numSteps = 0;
+    ElectrodeFrame_t frame;     // Previous step's frame
+    StepFields_t step;
+    
+    while (json->next(&token) == JSON_TOKEN) {
+        switch (token.depth) {
+            case 1:
+                if (token.type == JSON_KEY) {
+                    inScenarios = (strcmp(token.text, "scenarios") == 0);
+                } else if (token.type != JSON_ARRAY_START) {
+                    inScenarios = false;
+                }
+                break;
+            
+            case 2:
+                if (!inScenarios) break;
+                if (token.type == JSON_OBJECT_START) {
+                    memset(&scenario, 0, sizeof(scenario));
+                    scenario.sequence.cycleCount = 1;
+                    scenario.sequence.steps = &steps[stepsUsed];
+                    valid = true;
+                    numSteps = 0;
+                    inScenario = true;
+                } else if (token.type == JSON_OBJECT_END && inScenario) {
+                    inScenario = false;
+                    if (!registerScenario(&scenario, valid, numSteps)) {
+                        skipped++;
+                    }
+                }
+                break;
+            
+            case 3:
+                if (!inScenario) break;
+                if (token.type == JSON_KEY) {
+                    strncpy(scenarioKey, token.text, sizeof(scenarioKey) - 1);
+                } else if (strcmp(scenarioKey, "name") == 0) {
+                    valid &= (token.type == JSON_STRING);
+                    strncpy(scenario.name, token.text, SCENARIO_NAME_LEN - 1);
+                } else if (strcmp(scenarioKey, "cycles") == 0) {
+                    valid &= JsonTokenizer::toUnsigned(&token, &scenario.sequence.cycleCount);
+                } else if (strcmp(scenarioKey, "cycle_delay_ms") == 0) {
+                    valid &= JsonTokenizer::toUnsigned(&token, &scenario.sequence.cycleDelay_ms);
+                } else if (strcmp(scenarioKey, "steps") == 0) {
+                    // Each step starts from the previous step's frame
+                    inSteps = (token.type == JSON_ARRAY_START);
+                    frameClear(&frame);
+                }
+                break;
+            
+            case 4:
+                if (!inSteps) break;
+                if (token.type == JSON_OBJECT_START) {
+                    frameClear(&step.electrodes);
+                    step.high = true;
+                    step.valid = true;
+                    step.ms = 0;
+                    step.us = 0;
+                    inStep = true;
+                } else if (token.type == JSON_OBJECT_END && inStep) {
+                    inStep = false;
+                    if (!addStep(&step, &frame, numSteps)) {
+                        valid = false;
+                    } else {
+                        numSteps++;
+                    }
+                } else if (token.type != JSON_ARRAY_END && token.type != JSON_OBJECT_END) {
+                    valid = false;      // Step that is not an object
+                }
+                break;
+            
+            case 5:
+                if (!inStep) break;
+                if (token.type == JSON_KEY) {
+                    strncpy(stepKey, token.text, sizeof(stepKey) - 1);
+                } else if (strcmp(stepKey, "electrodes") == 0) {
+                    inElectrodes = (token.type == JSON_ARRAY_START);
+                } else if (strcmp(stepKey, "state") == 0) {
+                    step.high = (strcmp(token.text, "high") == 0);
+                    step.valid &= (token.type == JSON_STRING) &&
+                                  (step.high || strcmp(token.text, "low") == 0);
+                } else if (strcmp(stepKey, "duration_ms") == 0) {
+                    step.valid &= JsonTokenizer::toUnsigned(&token, &step.ms);
+                } else if (strcmp(stepKey, "duration_us") == 0) {
+                    step.valid &= JsonTokenizer::toUnsigned(&token, &step.us);
+                }
+                break;
+            
+            case 6:
+                if (!inElectrodes) break;
+                {
+                    uint32_t electrode = 0;
+                    uint8_t row, col;
+                    if (!JsonTokenizer::toUnsigned(&token, &electrode) ||
+                        electrode < 1 || electrode > NUM_ELECTRODES ||
+                        !arrayDriver->getRowColFromElectrode(electrode, &row, &col)) {
+                        step.valid = false;
+                    } else {
+                        frameSet(&step.electrodes, row, col, true);
+                    }
+                }
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    return numScenarios;
+}
+
+// Apply a finished step to 'frame' and store it; false if it is invalid or
+// the step pool is full
+bool ScenarioRegistry::addStep(const StepFields_t* step, ElectrodeFrame_t* frame, uint16_t index) {
+    uint16_t slot = stepsUsed + index;
+    if (!step->valid || slot >= SCENARIO_MAX_STEPS || step->ms > 2000000U ||
+        (uint64_t)step->ms * 1000U + step->us > 2000000000U) {
+        return false;
+    }
+    
+    if (step->high) {
+        *frame = step->electrodes;
+    } else {
+        frameAndNot(frame, frame, &step->electrodes);
+    }
+    
+    uint32_t duration_us = step->ms * 1000U + step->us;
+    frames[slot] = *frame;
+    memset(&steps[slot], 0, sizeof(ElectrodeStep_t));
+    steps[slot].frame = &frames[slot];
+    steps[slot].duration_ms = duration_us / 1000U;
+    steps[slot].duration_us = duration_us % 1000U;
+    return true;
+}
+
+// Register a finished scenario; false if it has to be skipped
+bool ScenarioRegistry::registerScenario(Scenario_t* scenario, bool valid, uint16_t numSteps) {
+    if (!valid || numSteps == 0 || scenario->name[0] == '\0' || scenario->sequence.cycleCount == 0 ||
+        find(scenario->name) || numScenarios >= SCENARIO_MAX) {
+        return false;
+    }
+    
+    scenario->sequence.numSteps = numSteps;
+    scenarios[numScenarios++] = *scenario;
+    stepsUsed += numSteps;
+    return true;
+}
+
+// ============================================================================
+// LOOKUP
+// ============================================================================
+
+// Compiled sequence of a scenario
+const ElectrodeSequence_t* ScenarioRegistry::find(const char* name) {
+    for (uint8_t i = 0; i < numScenarios; i++) {
+        if (strcmp(scenarios[i].name, name) == 0) {
+            return &scenarios[i].sequence;
+        }
+    }
+    return nullptr;
+}
+
+// Number of registered scenarios
+uint8_t ScenarioRegistry::getCount() {
+    return numScenarios;
+}
+
+// Invalid scenarios in the last load
+uint8_t ScenarioRegistry::getSkipped() {
+    return skipped;
+}
+
+// Registered scenario by index (file order)
+const Scenario_t* ScenarioRegistry::getScenario(uint8_t index) {
+    return (index < numScenarios) ? &scenarios[index] : nullptr;
+}
@@ -0,0 +1,393 @@
+#include "SequenceLibrary.h"
+
+// Constructor
+SequenceLibrary::SequenceLibrary() {
+    mounted = false;
+    active = 0;
+    generation = 0;
+    writeOffset = 0;
+    reclaimable = 0;
+    memset(index, 0, sizeof(index));
+    count = 0;
+}
+
+// ============================================================================
+// FLASH ACCESS
+// ============================================================================
+
+// Base address of sector 0 (A) or 1 (B)
+uintptr_t SequenceLibrary::sectorAddress(uint8_t sector) {
+    return sector ? SEQLIB_SECTOR_B_ADDR : SEQLIB_SECTOR_A_ADDR;
+}
+
+// Flash bytes used by a record
+uint32_t SequenceLibrary::recordSize(uint16_t numSteps) {
+    return sizeof(LibraryRecord_t) + (uint32_t)numSteps * sizeof(LibraryStep_t);
+}
+
+// Record at an offset of the active sector
+const LibraryRecord_t* SequenceLibrary::record(uint32_t offset) {
+    return (const LibraryRecord_t*)(sectorAddress(active) + offset);
+}
+
+// Check that a flash range reads as erased
+bool SequenceLibrary::isErased(uintptr_t address, uint32_t length) {
+    const uint32_t* word = (const uint32_t*)address;
+    for (uint32_t i = 0; i < length / 4U; i++) {
+        if (word[i] != SEQLIB_ERASED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Erase sector 0 (A) or 1 (B); flash must be unlocked
+bool SequenceLibrary::eraseSector(uint8_t sector) {
+    FLASH_EraseInitTypeDef erase;
+    memset(&erase, 0, sizeof(erase));
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Banks = FLASH_BANK_1;
+    erase.Sector = sector ? SEQLIB_SECTOR_B : SEQLIB_SECTOR_A;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    
+    uint32_t sectorError;
+    return HAL_FLASHEx_Erase(&erase, &sectorError) == HAL_OK &&
+           isErased(sectorAddress(sector), SEQLIB_SECTOR_SIZE);
+}
+
+// Program and verify whole words; flash must be unlocked
+bool SequenceLibrary::programWords(uintptr_t address, const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (uint32_t i = 0; i < length; i += 4U) {
+        uint32_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i, word) != HAL_OK ||
+            *(const volatile uint32_t*)(address + i) != word) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// MOUNT
+// ============================================================================
+
+// Find the active sector and index its records
+bool SequenceLibrary::init() {
+    const LibrarySectorHeader_t* headerA = (const LibrarySectorHeader_t*)sectorAddress(0);
+    const LibrarySectorHeader_t* headerB = (const LibrarySectorHeader_t*)sectorAddress(1);
+    bool validA = headerA->magic == SEQLIB_SECTOR_MAGIC;
+    bool validB = headerB->magic == SEQLIB_SECTOR_MAGIC;
+    bool ok = true;
+    
+    mounted = false;
+    HAL_FLASH_Unlock();
+    if (!validA && !validB) {
+        // Empty or never formatted
+        LibrarySectorHeader_t header = {SEQLIB_SECTOR_MAGIC, 1};
+        ok = eraseSector(0) && programWords(sectorAddress(0), &header, sizeof(header));
+        active = 0;
+    } else if (validA && validB) {
+        // Reset during compaction after the new header was written:
+        // keep the newer sector and finish erasing the older one
+        active = ((int32_t)(headerB->generation - headerA->generation) > 0) ? 1 : 0;
+        ok = eraseSector(active ^ 1);
+    } else {
+        active = validB ? 1 : 0;
+    }
+    HAL_FLASH_Lock();
+    
+    if (!ok) {
+        return false;
+    }
+    generation = ((const LibrarySectorHeader_t*)sectorAddress(active))->generation;
+    scan();
+    mounted = true;
+    return true;
+}
+
+// Walk the log of the active sector
+// Later records of an id supersede earlier ones (a reset between commit
+// and delete leaves both). Anything unreadable ends the log; the space
+// behind it is only reused after a compaction.
+void SequenceLibrary::scan() {
+    uint32_t offset = sizeof(LibrarySectorHeader_t);
+    count = 0;
+    reclaimable = 0;
+    
+    while (offset + sizeof(LibraryRecord_t) <= SEQLIB_SECTOR_SIZE) {
+        const LibraryRecord_t* rec = record(offset);
+        if (rec->magic == SEQLIB_ERASED &&
+            isErased(sectorAddress(active) + offset, SEQLIB_SECTOR_SIZE - offset)) {
+            break;
+        }
+        
+        uint32_t size = recordSize(rec->numSteps);
+        if (rec->magic != SEQLIB_RECORD_MAGIC || rec->numSteps == 0 ||
+            rec->numSteps > SEQLIB_MAX_STEPS || offset + size > SEQLIB_SECTOR_SIZE) {
+            reclaimable += SEQLIB_SECTOR_SIZE - offset;
+            offset = SEQLIB_SECTOR_SIZE;
+            break;
+        }
+        
+        uint32_t crc = crc32Update(0, &rec->id, size - offsetof(LibraryRecord_t, id));
+        if (rec->committed != 0 || rec->deleted != SEQLIB_ERASED || rec->crc != crc) {
+            reclaimable += size;
+        } else {
+            int8_t i = findIndex(rec->id);
+            if (i >= 0) {
+                reclaimable += recordSize(record(index[i].offset)->numSteps);
+                index[i].offset = offset;
+            } else if (count < SEQLIB_MAX_ENTRIES) {
+                index[count].id = rec->id;
+                index[count].offset = offset;
+                count++;
+            }
+        }
+        offset += size;
+    }
+    writeOffset = offset;
+}
+
+// Copy the live records to the other sector and switch to it
+bool SequenceLibrary::compact() {
+    uint8_t target = active ^ 1;
+    uint32_t offset = sizeof(LibrarySectorHeader_t);
+    
+    HAL_FLASH_Unlock();
+    bool ok = eraseSector(target);
+    for (uint8_t i = 0; ok && i < count; i++) {
+        const LibraryRecord_t* rec = record(index[i].offset);
+        uint32_t size = recordSize(rec->numSteps);
+        ok = programWords(sectorAddress(target) + offset, rec, size);
+        index[i].offset = offset;
+        offset += size;
+    }
+    
+    // The new header makes the target authoritative
+    LibrarySectorHeader_t header = {SEQLIB_SECTOR_MAGIC, generation + 1U};
+    ok = ok && programWords(sectorAddress(target), &header, sizeof(header));
+    if (ok) {
+        active = target;
+        generation = header.generation;
+        writeOffset = offset;
+        reclaimable = 0;
+        eraseSector(target ^ 1);
+    }
+    HAL_FLASH_Lock();
+    
+    if (!ok) {
+        scan();     // Old sector is untouched; rebuild the offsets
+    }
+    return ok;
+}
+
+// ============================================================================
+// STORE
+// ============================================================================
+
+// Save a sequence, replacing any sequence with the same id
+LibraryError_t SequenceLibrary::store(uint16_t id, const char* name, const ElectrodeSequence_t* sequence) {
+    size_t nameLength = name ? strlen(name) : 0;
+    if (!mounted || id == 0 || id == 0xFFFF || nameLength == 0 || nameLength >= SEQLIB_NAME_LEN ||
+        !sequence || !sequence->steps || sequence->numSteps == 0 ||
+        sequence->numSteps > SEQLIB_MAX_STEPS || sequence->cycleCount == 0) {
+        return LIBRARY_ERR_INVALID;
+    }
+    
+    uint16_t other;
+    if (findByName(name, &other) && other != id) {
+        return LIBRARY_ERR_NAME;
+    }
+    int8_t existing = findIndex(id);
+    if (existing < 0 && count >= SEQLIB_MAX_ENTRIES) {
+        return LIBRARY_ERR_ENTRIES;
+    }
+    
+    // Make room; the old version stays live until the new one is committed
+    uint32_t size = recordSize(sequence->numSteps);
+    if (writeOffset + size > SEQLIB_SECTOR_SIZE) {
+        LibraryUsage_t usage;
+        getUsage(&usage);
+        if (usage.usedBytes + size > usage.totalBytes) {
+            return LIBRARY_ERR_FULL;
+        }
+        if (!compact()) {
+            return LIBRARY_ERR_FLASH;
+        }
+        existing = findIndex(id);
+    }
+    
+    LibraryRecord_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SEQLIB_RECORD_MAGIC;
+    header.committed = SEQLIB_ERASED;
+    header.deleted = SEQLIB_ERASED;
+    header.id = id;
+    header.numSteps = sequence->numSteps;
+    header.cycleCount = sequence->cycleCount;
+    header.cycleDelay_ms = sequence->cycleDelay_ms;
+    memcpy(header.name, name, nameLength);
+    
+    // First pass computes the CRC, second pass programs the steps
+    LibraryStep_t step;
+    frameClear(&step.frame);
+    header.crc = crc32Update(0, &header.id, sizeof(header) - offsetof(LibraryRecord_t, id));
+    for (uint16_t i = 0; i < sequence->numSteps; i++) {
+        stepApply(&sequence->steps[i], &step.frame);
+        step.duration_us = stepDurationMicros(&sequence->steps[i]);
+        header.crc = crc32Update(header.crc, &step, sizeof(step));
+    }
+    
+    uintptr_t address = sectorAddress(active) + writeOffset;
+    uint32_t offset = writeOffset;
+    writeOffset += size;    // Space is consumed even if programming fails
+    
+    HAL_FLASH_Unlock();
+    bool ok = programWords(address, &header, sizeof(header));
+    frameClear(&step.frame);
+    for (uint16_t i = 0; ok && i < sequence->numSteps; i++) {
+        stepApply(&sequence->steps[i], &step.frame);
+        step.duration_us = stepDurationMicros(&sequence->steps[i]);
+        ok = programWords(address + recordSize(i), &step, sizeof(step));
+    }
+    
+    // Commit, then retire the old version
+    const uint32_t zero = 0;
+    ok = ok && programWords(address + offsetof(LibraryRecord_t, committed), &zero, sizeof(zero));
+    if (ok && existing >= 0) {
+        uintptr_t old = sectorAddress(active) + index[existing].offset;
+        programWords(old + offsetof(LibraryRecord_t, deleted), &zero, sizeof(zero));
+    }
+    HAL_FLASH_Lock();
+    
+    if (!ok) {
+        reclaimable += size;
+        return LIBRARY_ERR_FLASH;
+    }
+    
+    if (existing >= 0) {
+        reclaimable += recordSize(record(index[existing].offset)->numSteps);
+        index[existing].offset = offset;
+    } else {
+        index[count].id = id;
+        index[count].offset = offset;
+        count++;
+    }
+    return LIBRARY_OK;
+}
+
+// Delete a sequence
+LibraryError_t SequenceLibrary::remove(uint16_t id) {
+    int8_t i = mounted ? findIndex(id) : -1;
+    if (i < 0) {
+        return LIBRARY_ERR_NOT_FOUND;
+    }
+    
+    const uint32_t zero = 0;
+    HAL_FLASH_Unlock();
+    bool ok = programWords(sectorAddress(active) + index[i].offset + offsetof(LibraryRecord_t, deleted),
+                           &zero, sizeof(zero));
+    HAL_FLASH_Lock();
+    if (!ok) {
+        return LIBRARY_ERR_FLASH;
+    }
+    
+    reclaimable += recordSize(record(index[i].offset)->numSteps);
+    memmove(&index[i], &index[i + 1], (count - i - 1) * sizeof(IndexEntry_t));
+    count--;
+    return LIBRARY_OK;
+}
+
+// ============================================================================
+// LOOKUP
+// ============================================================================
+
+// Index slot of an id (-1 if not stored)
+int8_t SequenceLibrary::findIndex(uint16_t id) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (index[i].id == id) {
+            return (int8_t)i;
+        }
+    }
+    return -1;
+}
+
+// Look up a sequence id by name
+bool SequenceLibrary::findByName(const char* name, uint16_t* id) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strncmp(record(index[i].offset)->name, name, SEQLIB_NAME_LEN) == 0) {
+            *id = index[i].id;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Build a runnable sequence from a stored record
+bool SequenceLibrary::load(uint16_t id, ElectrodeStep_t* steps, uint16_t maxSteps, ElectrodeSequence_t* sequence) {
+    int8_t i = findIndex(id);
+    if (i < 0 || !steps || !sequence) {
+        return false;
+    }
+    
+    const LibraryRecord_t* rec = record(index[i].offset);
+    if (rec->numSteps > maxSteps) {
+        return false;
+    }
+    
+    const LibraryStep_t* stored = (const LibraryStep_t*)(rec + 1);
+    for (uint16_t step = 0; step < rec->numSteps; step++) {
+        memset(&steps[step], 0, sizeof(ElectrodeStep_t));
+        steps[step].frame = &stored[step].frame;
+        steps[step].duration_ms = stored[step].duration_us / 1000U;
+        steps[step].duration_us = stored[step].duration_us % 1000U;
+    }
+    
+    sequence->steps = steps;
+    sequence->numSteps = rec->numSteps;
+    sequence->cycleCount = rec->cycleCount;
+    sequence->cycleDelay_ms = rec->cycleDelay_ms;
+    return true;
+}
+
+// Number of stored sequences
+uint8_t SequenceLibrary::getCount() {
+    return count;
+}
+
+// Describe a stored sequence
+bool SequenceLibrary::getEntry(uint8_t i, LibraryEntry_t* entry) {
+    if (i >= count || !entry) {
+        return false;
+    }
+    
+    const LibraryRecord_t* rec = record(index[i].offset);
+    entry->id = rec->id;
+    memcpy(entry->name, rec->name, SEQLIB_NAME_LEN);
+    entry->name[SEQLIB_NAME_LEN - 1] = '\0';
+    entry->numSteps = rec->numSteps;
+    entry->cycleCount = rec->cycleCount;
+    entry->cycleDelay_ms = rec->cycleDelay_ms;
+    entry->bytes = recordSize(rec->numSteps);
+    return true;
+}
+
+// Flash usage of the active sector
+void SequenceLibrary::getUsage(LibraryUsage_t* usage) {
+    if (!usage) {
+        return;
+    }
+    
+    usage->sequences = count;
+    usage->usedBytes = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        usage->usedBytes += recordSize(record(index[i].offset)->numSteps);
+    }
+    usage->reclaimableBytes = reclaimable;
+    usage->freeBytes = SEQLIB_SECTOR_SIZE - writeOffset;
+    usage->totalBytes = SEQLIB_SECTOR_SIZE - sizeof(LibrarySectorHeader_t);
+    usage->generation = generation;
+}
@@ -0,0 +1,295 @@
+#include "SequenceProgram.h"
+
+// Constructor
+SequenceProgram::SequenceProgram(ArrayDriver* driver) {
+    arrayDriver = driver;
+    code = nullptr;
+    codeLength = 0;
+    frames = nullptr;
+    numFrames = 0;
+    memset(labels, 0xFF, sizeof(labels));
+    running = false;
+    pc = 0;
+    depth = 0;
+    frameClear(&pending);
+    startTime = 0;
+    wakeAt_us = 0;
+    error = PROGRAM_OK;
+}
+
+// ============================================================================
+// LOADER
+// ============================================================================
+
+// Operand size of an opcode (0xFF: unknown opcode)
+uint8_t SequenceProgram::operandBytes(uint8_t opcode) {
+    switch (opcode) {
+        case OP_END:
+        case OP_CLEAR:
+        case OP_ENDLOOP:
+        case OP_RET:
+            return 0;
+        case OP_FRAME:
+        case OP_LABEL:
+        case OP_JUMP:
+        case OP_CALL:
+            return 1;
+        case OP_ON:
+        case OP_OFF:
+        case OP_WAIT_US:
+        case OP_LOOP:
+            return 2;
+        case OP_WAIT_MS:
+            return 4;
+        default:
+            return 0xFF;
+    }
+}
+
+// Load a program
+ProgramError_t SequenceProgram::load(const uint8_t* program, uint16_t length,
+                                     const ElectrodeFrame_t* frameTable, uint8_t frameCount) {
+    stop();
+    code = program;
+    codeLength = program ? length : 0;
+    frames = frameTable;
+    numFrames = frameTable ? frameCount : 0;
+    
+    error = validate();
+    if (error != PROGRAM_OK) {
+        code = nullptr;
+        codeLength = 0;
+    }
+    return error;
+}
+
+// Check operands and loop nesting, and record label positions
+// LOOP/ENDLOOP must nest statically; CALL/RET depth is checked at run time.
+ProgramError_t SequenceProgram::validate() {
+    memset(labels, 0xFF, sizeof(labels));
+    if (!code || codeLength == 0) {
+        return PROGRAM_ERR_TRUNCATED;
+    }
+    
+    uint8_t loopDepth = 0;
+    uint16_t i = 0;
+    while (i < codeLength) {
+        uint8_t opcode = code[i];
+        uint8_t size = operandBytes(opcode);
+        if (size == 0xFF) {
+            return PROGRAM_ERR_OPCODE;
+        }
+        if (i + 1U + size > codeLength) {
+            return PROGRAM_ERR_TRUNCATED;
+        }
+        const uint8_t* operand = &code[i + 1];
+        
+        switch (opcode) {
+            case OP_FRAME:
+                if (operand[0] >= numFrames) {
+                    return PROGRAM_ERR_FRAME;
+                }
+                break;
+            case OP_ON:
+            case OP_OFF:
+                if (operand[0] >= NUM_ROWS || operand[1] >= NUM_COLS) {
+                    return PROGRAM_ERR_ELECTRODE;
+                }
+                break;
+            case OP_LOOP:
+                if ((operand[0] | (operand[1] << 8)) == 0 || ++loopDepth > PROGRAM_MAX_DEPTH) {
+                    return PROGRAM_ERR_LOOP;
+                }
+                break;
+            case OP_ENDLOOP:
+                if (loopDepth == 0) {
+                    return PROGRAM_ERR_LOOP;
+                }
+                loopDepth--;
+                break;
+            case OP_LABEL:
+                if (operand[0] >= PROGRAM_MAX_LABELS || labels[operand[0]] != 0xFFFF) {
+                    return PROGRAM_ERR_LABEL;
+                }
+                labels[operand[0]] = i;
+                break;
+            default:
+                break;
+        }
+        i += 1U + size;
+    }
+    if (loopDepth != 0) {
+        return PROGRAM_ERR_LOOP;
+    }
+    
+    // Every JUMP/CALL target must exist
+    for (i = 0; i < codeLength; i += 1U + operandBytes(code[i])) {
+        if ((code[i] == OP_JUMP || code[i] == OP_CALL) &&
+            (code[i + 1] >= PROGRAM_MAX_LABELS || labels[code[i + 1]] == 0xFFFF)) {
+            return PROGRAM_ERR_LABEL;
+        }
+    }
+    return PROGRAM_OK;
+}
+
+// ============================================================================
+// INTERPRETER
+// ============================================================================
+
+// Start the loaded program
+bool SequenceProgram::start() {
+    if (!code || arrayDriver->isSequenceRunning()) {
+        return false;
+    }
+    
+    pc = 0;
+    depth = 0;
+    error = PROGRAM_OK;
+    arrayDriver->getPattern(&pending);
+    startTime = HAL_GetTick();
+    wakeAt_us = 0;
+    running = true;
+    
+    execute();
+    return true;
+}
+
+// Run instructions until the next wait, the end, or the per-call budget
+// Returns true when it stopped at a wait.
+bool SequenceProgram::execute() {
+    for (uint16_t ops = 0; ops < PROGRAM_MAX_OPS_PER_UPDATE; ops++) {
+        if (pc >= codeLength) {
+            arrayDriver->setPattern(&pending);
+            running = false;
+            return false;
+        }
+        
+        uint8_t opcode = code[pc];
+        const uint8_t* operand = &code[pc + 1];
+        pc += 1U + operandBytes(opcode);
+        
+        switch (opcode) {
+            case OP_END:
+                arrayDriver->setPattern(&pending);
+                running = false;
+                return false;
+            
+            case OP_FRAME:
+                pending = frames[operand[0]];
+                break;
+            
+            case OP_ON:
+            case OP_OFF:
+                frameSet(&pending, operand[0], operand[1], opcode == OP_ON);
+                break;
+            
+            case OP_CLEAR:
+                frameClear(&pending);
+                break;
+            
+            case OP_WAIT_MS:
+            case OP_WAIT_US:
+                arrayDriver->setPattern(&pending);
+                if (opcode == OP_WAIT_MS) {
+                    uint32_t ms = operand[0] | (operand[1] << 8) | (operand[2] << 16) | ((uint32_t)operand[3] << 24);
+                    wakeAt_us += (uint64_t)ms * 1000U;
+                } else {
+                    wakeAt_us += (uint32_t)(operand[0] | (operand[1] << 8));
+                }
+                return true;
+            
+            case OP_LOOP:
+                if (depth >= PROGRAM_MAX_DEPTH) {
+                    fail(PROGRAM_ERR_STACK);
+                    return false;
+                }
+                stack[depth].returnPc = pc;
+                stack[depth].remaining = (uint16_t)(operand[0] | (operand[1] << 8));
+                stack[depth].isCall = false;
+                depth++;
+                break;
+            
+            case OP_ENDLOOP:
+                if (depth == 0 || stack[depth - 1].isCall) {
+                    fail(PROGRAM_ERR_STACK);  // Jumped out of or into a loop body
+                    return false;
+                }
+                if (--stack[depth - 1].remaining > 0) {
+                    pc = stack[depth - 1].returnPc;
+                } else {
+                    depth--;
+                }
+                break;
+            
+            case OP_LABEL:
+                break;
+            
+            case OP_JUMP:
+                pc = labels[operand[0]];
+                break;
+            
+            case OP_CALL:
+                if (depth >= PROGRAM_MAX_DEPTH) {
+                    fail(PROGRAM_ERR_STACK);
+                    return false;
+                }
+                stack[depth].returnPc = pc;
+                stack[depth].remaining = 0;
+                stack[depth].isCall = true;
+                depth++;
+                pc = labels[operand[0]];
+                break;
+            
+            case OP_RET:
+                if (depth == 0 || !stack[depth - 1].isCall) {
+                    fail(PROGRAM_ERR_STACK);
+                    return false;
+                }
+                pc = stack[--depth].returnPc;
+                break;
+        }
+    }
+    
+    // Budget used up without a wait: continue on the next update()
+    return false;
+}
+
+// Stop on a run-time error, keeping the last applied frame
+void SequenceProgram::fail(ProgramError_t err) {
+    error = err;
+    running = false;
+}
+
+// Advance the program
+void SequenceProgram::update() {
+    if (!running) {
+        return;
+    }
+    
+    uint64_t elapsed_us = (uint64_t)(HAL_GetTick() - startTime) * 1000U;
+    while (running && elapsed_us >= wakeAt_us) {
+        if (!execute()) {
+            break;  // Stopped, or out of budget
+        }
+    }
+}
+
+// Stop the program
+void SequenceProgram::stop() {
+    running = false;
+}
+
+// Check if the program is running
+bool SequenceProgram::isRunning() {
+    return running;
+}
+
+// Error of the last load/run
+ProgramError_t SequenceProgram::getError() {
+    return error;
+}
+
+// Offset of the next instruction
+uint16_t SequenceProgram::getPc() {
+    return pc;
+}
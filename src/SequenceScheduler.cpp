@@ -0,0 +1,257 @@
+#include "SequenceScheduler.h"
+
+// Constructor
+SequenceScheduler::SequenceScheduler(ArrayDriver* driver) {
+    arrayDriver = driver;
+    memset(tracks, 0, sizeof(tracks));
+    frameClear(&output);
+    memset(activeConflicts, 0, sizeof(activeConflicts));
+    numConflicts = 0;
+    totalConflicts = 0;
+}
+
+// ============================================================================
+// TRACK CONTROL
+// ============================================================================
+
+// Start a sequence on a free track
+int8_t SequenceScheduler::addTrack(const ElectrodeSequence_t* sequence) {
+    if (!sequence || !sequence->steps || sequence->numSteps == 0 || sequence->cycleCount == 0) {
+        return -1;
+    }
+    if (arrayDriver->isSequenceRunning()) {
+        return -1;  // The driver's own engine owns the outputs
+    }
+    
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TRACKS; i++) {
+        SequenceTrack_t* track = &tracks[i];
+        if (track->sequence) {
+            continue;
+        }
+        
+        track->sequence = sequence;
+        track->running = true;
+        track->cycle = 0;
+        track->step = 0;
+        track->startTime = HAL_GetTick();
+        frameClear(&track->frame);
+        stepApply(&sequence->steps[0], &track->frame);
+        track->stepEnd_us = stepDuration(track);
+        
+        merge();
+        return (int8_t)i;
+    }
+    return -1;
+}
+
+// Release a track and drop its electrodes from the output
+void SequenceScheduler::removeTrack(uint8_t track) {
+    if (track >= SCHEDULER_MAX_TRACKS || !tracks[track].sequence) {
+        return;
+    }
+    
+    memset(&tracks[track], 0, sizeof(SequenceTrack_t));
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TRACKS; i++) {
+        activeConflicts[track][i] = 0;
+        activeConflicts[i][track] = 0;
+    }
+    merge();
+}
+
+// Stop and release all tracks
+void SequenceScheduler::stop() {
+    memset(tracks, 0, sizeof(tracks));
+    memset(activeConflicts, 0, sizeof(activeConflicts));
+}
+
+// Hold time of the track's current step (the cycle delay follows the last
+// step of every cycle but the final one)
+uint64_t SequenceScheduler::stepDuration(const SequenceTrack_t* track) {
+    const ElectrodeSequence_t* sequence = track->sequence;
+    uint64_t duration = stepDurationMicros(&sequence->steps[track->step]);
+    if (track->step + 1U == sequence->numSteps && track->cycle + 1U < sequence->cycleCount) {
+        duration += (uint64_t)sequence->cycleDelay_ms * 1000U;
+    }
+    return duration;
+}
+
+// Apply every step of the track whose start time has passed
+// Returns true if the track frame may have changed.
+bool SequenceScheduler::advanceTrack(SequenceTrack_t* track, uint32_t now) {
+    const ElectrodeSequence_t* sequence = track->sequence;
+    uint64_t elapsed_us = (uint64_t)(now - track->startTime) * 1000U;
+    bool changed = false;
+    
+    while (track->running && elapsed_us >= track->stepEnd_us) {
+        if (++track->step >= sequence->numSteps) {
+            track->step = 0;
+            if (++track->cycle >= sequence->cycleCount) {
+                track->running = false;  // Final frame stays until removeTrack()
+                break;
+            }
+        }
+        
+        stepApply(&sequence->steps[track->step], &track->frame);
+        track->stepEnd_us += stepDuration(track);
+        changed = true;
+    }
+    return changed;
+}
+
+// Advance all tracks and write the merged frame
+void SequenceScheduler::update() {
+    uint32_t now = HAL_GetTick();
+    bool changed = false;
+    
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TRACKS; i++) {
+        if (tracks[i].sequence && advanceTrack(&tracks[i], now)) {
+            changed = true;
+        }
+    }
+    
+    if (changed) {
+        merge();
+    }
+}
+
+// OR the track frames into the output, check it and write it
+void SequenceScheduler::merge() {
+    frameClear(&output);
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TRACKS; i++) {
+        if (tracks[i].sequence) {
+            frameOr(&output, &output, &tracks[i].frame);
+        }
+    }
+    
+    checkConflicts();
+    arrayDriver->setPattern(&output);
+}
+
+// ============================================================================
+// CONFLICT DETECTION
+// ============================================================================
+
+// Electrodes energized by the active rows of one frame and the active
+// columns of another under static drive
+static void crossFrame(ElectrodeFrame_t* out, const ElectrodeFrame_t* rowsFrom, const ElectrodeFrame_t* colsFrom) {
+    uint16_t rows = frameActiveRows(rowsFrom);
+    uint16_t cols = frameActiveCols(colsFrom);
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        out->rows[row] = (rows & (1U << row)) ? cols : 0;
+    }
+}
+
+// Compare every pair of tracks against the merged output
+void SequenceScheduler::checkConflicts() {
+    bool staticDrive = !arrayDriver->isScanning();
+    
+    for (uint8_t a = 0; a < SCHEDULER_MAX_TRACKS; a++) {
+        if (!tracks[a].sequence) {
+            continue;
+        }
+        for (uint8_t b = a + 1; b < SCHEDULER_MAX_TRACKS; b++) {
+            if (!tracks[b].sequence) {
+                continue;
+            }
+            
+            const ElectrodeFrame_t* frameA = &tracks[a].frame;
+            const ElectrodeFrame_t* frameB = &tracks[b].frame;
+            uint8_t present = 0;
+            
+            // Same electrode claimed by both tracks
+            ElectrodeFrame_t claimed;
+            frameAnd(&claimed, frameA, frameB);
+            if (frameCount(&claimed) > 0) {
+                present |= 1U << TRACK_CONFLICT_CLAIM;
+                if (!(activeConflicts[a][b] & (1U << TRACK_CONFLICT_CLAIM))) {
+                    reportConflict(TRACK_CONFLICT_CLAIM, a, b, &claimed);
+                }
+            }
+            
+            // Row of one track crossing a column of the other
+            if (staticDrive) {
+                ElectrodeFrame_t ghosts, cross;
+                crossFrame(&ghosts, frameA, frameB);
+                crossFrame(&cross, frameB, frameA);
+                frameOr(&ghosts, &ghosts, &cross);
+                frameAndNot(&ghosts, &ghosts, &output);
+                if (frameCount(&ghosts) > 0) {
+                    present |= 1U << TRACK_CONFLICT_GHOST;
+                    if (!(activeConflicts[a][b] & (1U << TRACK_CONFLICT_GHOST))) {
+                        reportConflict(TRACK_CONFLICT_GHOST, a, b, &ghosts);
+                    }
+                }
+            }
+            
+            activeConflicts[a][b] = present;
+        }
+    }
+}
+
+// Record a newly detected conflict
+void SequenceScheduler::reportConflict(TrackConflictType_t type, uint8_t a, uint8_t b, const ElectrodeFrame_t* affected) {
+    totalConflicts++;
+    if (numConflicts >= SCHEDULER_MAX_CONFLICTS) {
+        return;
+    }
+    
+    TrackConflict_t* conflict = &conflicts[numConflicts++];
+    conflict->type = type;
+    conflict->trackA = a;
+    conflict->trackB = b;
+    frameFirst(affected, &conflict->row, &conflict->col);
+    conflict->electrodes = frameCount(affected);
+    conflict->time_ms = HAL_GetTick();
+}
+
+// ============================================================================
+// STATUS
+// ============================================================================
+
+// Check if a track is still stepping
+bool SequenceScheduler::isTrackRunning(uint8_t track) {
+    return track < SCHEDULER_MAX_TRACKS && tracks[track].sequence && tracks[track].running;
+}
+
+// Number of tracks still stepping
+uint8_t SequenceScheduler::getRunningTracks() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TRACKS; i++) {
+        if (tracks[i].sequence && tracks[i].running) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Last merged frame
+void SequenceScheduler::getOutput(ElectrodeFrame_t* frame) {
+    if (frame) {
+        *frame = output;
+    }
+}
+
+// Number of conflicts detected since the last clearConflicts()
+uint32_t SequenceScheduler::getConflictCount() {
+    return totalConflicts;
+}
+
+// Number of conflict records available
+uint16_t SequenceScheduler::getStoredConflicts() {
+    return numConflicts;
+}
+
+// Read a conflict record (0 = first detected)
+bool SequenceScheduler::getConflict(uint16_t index, TrackConflict_t* conflict) {
+    if (index >= numConflicts || !conflict) {
+        return false;
+    }
+    *conflict = conflicts[index];
+    return true;
+}
+
+// Drop the conflict records (conflicts still present are not re-reported)
+void SequenceScheduler::clearConflicts() {
+    numConflicts = 0;
+    totalConflicts = 0;
+}
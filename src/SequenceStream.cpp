@@ -0,0 +1,148 @@
+#include "SequenceStream.h"
+
+// Constructor
+SequenceStream::SequenceStream(ArrayDriver* driver) {
+    arrayDriver = driver;
+    head = 0;
+    tail = 0;
+    active = false;
+    inputEnded = false;
+    playing = false;
+    starved = false;
+    startTime = 0;
+    stepEnd_us = 0;
+    starvedSince = 0;
+    stepsPlayed = 0;
+    underruns = 0;
+    underrunTime_ms = 0;
+}
+
+// ============================================================================
+// PRODUCER
+// ============================================================================
+
+// Start an empty stream
+bool SequenceStream::begin() {
+    if (active || arrayDriver->isSequenceRunning()) {
+        return false;
+    }
+    
+    head = 0;
+    tail = 0;
+    inputEnded = false;
+    playing = false;
+    starved = true;     // Nothing to play until the first push
+    startTime = HAL_GetTick();
+    stepEnd_us = 0;
+    starvedSince = startTime;
+    stepsPlayed = 0;
+    underruns = 0;
+    underrunTime_ms = 0;
+    active = true;
+    return true;
+}
+
+// Append one step
+bool SequenceStream::push(const ElectrodeFrame_t* frame, uint32_t duration_us) {
+    if (!active || inputEnded || !frame || getFree() == 0) {
+        return false;
+    }
+    
+    StreamStep_t* step = &ring[head & (STREAM_RING_STEPS - 1U)];
+    step->frame = *frame;
+    step->duration_us = duration_us;
+    head = head + 1U;   // Publish after the slot is written
+    return true;
+}
+
+// No more steps will be pushed
+void SequenceStream::end() {
+    if (active) {
+        inputEnded = true;
+    }
+}
+
+// Stop at once
+void SequenceStream::abort() {
+    active = false;
+    inputEnded = false;
+}
+
+// ============================================================================
+// CONSUMER
+// ============================================================================
+
+// Apply every step whose start time has passed
+void SequenceStream::update() {
+    if (!active) {
+        return;
+    }
+    
+    uint32_t now = HAL_GetTick();
+    uint64_t elapsed_us = (uint64_t)(now - startTime) * 1000U;
+    
+    while (elapsed_us >= stepEnd_us) {
+        if (tail == head) {
+            if (inputEnded) {
+                active = false;     // Last step has run its full duration
+            } else if (!starved) {
+                starved = true;
+                starvedSince = now;
+                underruns++;
+            }
+            return;
+        }
+        
+        if (starved) {
+            // Data arrived after a gap: restart the schedule from now
+            if (playing) {
+                underrunTime_ms += now - starvedSince;
+            }
+            starved = false;
+            startTime = now;
+            stepEnd_us = 0;
+            elapsed_us = 0;
+        }
+        
+        const StreamStep_t* step = &ring[tail & (STREAM_RING_STEPS - 1U)];
+        arrayDriver->setPattern(&step->frame);
+        stepEnd_us += step->duration_us;
+        tail = tail + 1U;   // Slot may be reused from here on
+        stepsPlayed++;
+        playing = true;
+    }
+}
+
+// ============================================================================
+// STATUS
+// ============================================================================
+
+// Check if a stream is open or still playing
+bool SequenceStream::isActive() {
+    return active;
+}
+
+// Steps waiting to be played
+uint16_t SequenceStream::getBuffered() {
+    return (uint16_t)(head - tail);
+}
+
+// Steps that can be pushed now
+uint16_t SequenceStream::getFree() {
+    return STREAM_RING_STEPS - getBuffered();
+}
+
+// Stream state and underrun statistics
+void SequenceStream::getStatus(StreamStatus_t* status) {
+    if (!status) {
+        return;
+    }
+    
+    status->active = active;
+    status->inputEnded = inputEnded;
+    status->buffered = getBuffered();
+    status->free = getFree();
+    status->stepsPlayed = stepsPlayed;
+    status->underruns = underruns;
+    status->underrunTime_ms = underrunTime_ms;
+}
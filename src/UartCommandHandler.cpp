@@ -1,12 +1,21 @@
 #include "UartCommandHandler.h"
+#include "CriticalSection.h"
 #include <stdio.h>
 
 // Constructor
-UartCommandHandler::UartCommandHandler(ArrayDriver* driver, UART_HandleTypeDef* uart) {
+UartCommandHandler::UartCommandHandler(ArrayDriver* driver, UART_HandleTypeDef* uart)
+    : sequenceStream(driver), scenarios(driver) {
     arrayDriver = driver;
     huart = uart;
     cmdBufferIndex = 0;
     cmdComplete = false;
+    sequenceStarted = false;
+    sequenceTimer = nullptr;
+    streamLowReported = false;
+    streamEnded = false;
+    preemptedRuns = 0;
+    mappingSwapPending = false;
+    scenariosStale = false;
 }
 
 // Initialization
@@ -15,9 +24,32 @@ void UartCommandHandler::init() {
     cmdComplete = false;
     memset(cmdBuffer, 0, sizeof(cmdBuffer));
     sendResponse("ArrayDriver UART Command Handler Ready\n");
+    
+    if (sequenceLibrary.init()) {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Sequence library: %u stored\n", sequenceLibrary.getCount());
+        sendResponse(responseBuffer);
+    } else {
+        sendError("Sequence library flash error");
+    }
+    
+    // Mapping check made by the driver at boot
+    MappingReport_t mappingReport;
+    arrayDriver->getMappingReport(&mappingReport);
+    sendMappingReport(&mappingReport);
+    
+    scenarios.load();
+    snprintf(responseBuffer, sizeof(responseBuffer), "Scenarios: %u loaded, %u skipped\n",
+            scenarios.getCount(), scenarios.getSkipped());
+    sendResponse(responseBuffer);
     sendResponse("Type 'HELP' for command list\n");
 }
 
+// Select the step timer used by START
+void UartCommandHandler::setSequenceTimer(TIM_HandleTypeDef* htim) {
+    sequenceTimer = htim;
+}
+
 // Process incoming byte
 void UartCommandHandler::processByte(uint8_t byte) {
     // Check for buffer overflow
@@ -60,6 +92,77 @@ void UartCommandHandler::processCommands() {
     memset(cmdBuffer, 0, sizeof(cmdBuffer));
 }
 
+// Advance the asynchronous sequence
+void UartCommandHandler::update() {
+    arrayDriver->updateSequence();
+    sequenceStream.update();
+    
+    // Ask the host for more steps before the stream runs dry
+    StreamStatus_t stream;
+    sequenceStream.getStatus(&stream);
+    if (stream.active && !stream.inputEnded && !streamLowReported &&
+        stream.buffered < STREAM_LOW_WATER) {
+        streamLowReported = true;
+        snprintf(responseBuffer, sizeof(responseBuffer), "STREAM|LOW|%u\n", stream.free);
+        sendResponse(responseBuffer);
+    }
+    
+    if (streamEnded && !stream.active) {
+        streamEnded = false;
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Stream complete (%lu steps, %lu underruns, %lu ms starved)\n",
+                (unsigned long)stream.stepsPlayed, (unsigned long)stream.underruns,
+                (unsigned long)stream.underrunTime_ms);
+        sendResponse(responseBuffer);
+    }
+    
+    // An urgent sequence ended and gave control back to the run it interrupted
+    SequenceProgress_t progress;
+    arrayDriver->getSequenceProgress(&progress);
+    if (progress.preempted < preemptedRuns && progress.running) {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Preemption ended, %s cycle %lu/%lu, step %u/%u\n",
+                progress.paused ? "paused at" : "resumed at",
+                (unsigned long)progress.cycle + 1, (unsigned long)progress.cycleCount,
+                progress.step + 1, progress.numSteps);
+        sendResponse(responseBuffer);
+    }
+    preemptedRuns = progress.preempted;
+    
+    // A reloaded mapping took over at a step edge
+    if (mappingSwapPending) {
+        MappingReload_t reload;
+        arrayDriver->getMappingReload(&reload);
+        if (!reload.swapPending) {
+            mappingSwapPending = false;
+            snprintf(responseBuffer, sizeof(responseBuffer),
+                    "Mapping swapped at step edge: %lu cycles\n", (unsigned long)reload.swapCycles);
+            sendResponse(responseBuffer);
+        }
+    }
+    
+    // Scenario frames were resolved with the old mapping; recompile them
+    // once no sequence can be using them
+    if (scenariosStale && !mappingSwapPending && !arrayDriver->isSequenceRunning()) {
+        scenariosStale = false;
+        scenarios.load();
+        snprintf(responseBuffer, sizeof(responseBuffer), "Scenarios recompiled: %u loaded, %u skipped\n",
+                scenarios.getCount(), scenarios.getSkipped());
+        sendResponse(responseBuffer);
+    }
+    
+    if (sequenceStarted && !arrayDriver->isSequenceRunning()) {
+        sequenceStarted = false;
+        
+        SequenceTiming_t timing;
+        arrayDriver->getSequenceTiming(&timing);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Sequence complete (end drift %lu us, worst step %lu us)\n",
+                (unsigned long)timing.endDrift_us, (unsigned long)timing.maxLatency_us);
+        sendResponse(responseBuffer);
+    }
+}
+
 // Send response
 void UartCommandHandler::sendResponse(const char* response) {
     HAL_UART_Transmit(huart, (uint8_t*)response, strlen(response), 1000);
@@ -90,6 +193,30 @@ void UartCommandHandler::parseCommand(char* cmd) {
     if (strncmp(cmd, "START|", 6) == 0) {
         parseElectrodeCommand(cmd);
     }
+    else if (strncmp(cmd, "STREAM|", 7) == 0) {
+        parseStreamCommand(cmd);
+    }
+    else if (strncmp(cmd, "STORE|", 6) == 0) {
+        parseStoreCommand(cmd);
+    }
+    else if (strncmp(cmd, "RUN|", 4) == 0) {
+        parseRunCommand(cmd);
+    }
+    else if (strncmp(cmd, "LIB", 3) == 0) {
+        parseLibraryCommand(cmd);
+    }
+    else if (strncmp(cmd, "DELETE|", 7) == 0) {
+        parseDeleteCommand(cmd);
+    }
+    else if (strncmp(cmd, "PAUSE", 5) == 0) {
+        parsePauseCommand(cmd);
+    }
+    else if (strncmp(cmd, "RESUME", 6) == 0) {
+        parseResumeCommand(cmd);
+    }
+    else if (strncmp(cmd, "PREEMPT|", 8) == 0) {
+        parsePreemptCommand(cmd);
+    }
     else if (strncmp(cmd, "SET|", 4) == 0) {
         parseSingleElectrodeCommand(cmd);
     }
@@ -117,18 +244,50 @@ void UartCommandHandler::parseCommand(char* cmd) {
     else if (strncmp(cmd, "RELOAD", 6) == 0) {
         parseReloadMappingCommand(cmd);
     }
+    else if (strncmp(cmd, "MAPCHECK", 8) == 0) {
+        parseMapCheckCommand(cmd);
+    }
+    else if (strncmp(cmd, "STAGE|", 6) == 0) {
+        parseStageCommand(cmd);
+    }
+    else if (strncmp(cmd, "COMMIT", 6) == 0) {
+        parseCommitCommand(cmd);
+    }
+    else if (strncmp(cmd, "DISCARD", 7) == 0) {
+        parseDiscardCommand(cmd);
+    }
+    else if (strncmp(cmd, "FRAME", 5) == 0) {
+        parseFrameCommand(cmd);
+    }
+    else if (strncmp(cmd, "BENCH", 5) == 0) {
+        parseBenchCommand(cmd);
+    }
     else if (strncmp(cmd, "HELP", 4) == 0) {
         sendResponse("\n=== ArrayDriver Commands ===\n");
         sendResponse("START|REPS|DELAY|STEPS|ID1,DUR1|ID2,DUR2|...|END - Execute sequence\n");
+        sendResponse("  ID may be a set (e.g. 10+20+30,500); DUR in ms, or in us with a suffix (e.g. 5,250us)\n");
+        sendResponse("STREAM|BEGIN / STREAM|ID1,DUR1|... / STREAM|END / STREAM|ABORT - Streamed sequence\n");
+        sendResponse("STORE|ID|NAME|REPS|DELAY|STEPS|...|END - Save sequence to flash\n");
+        sendResponse("RUN|ID or RUN|NAME - Run stored sequence or TestScenarios.json scenario\n");
+        sendResponse("LIB - List stored sequences, flash usage and scenarios\n");
+        sendResponse("DELETE|ID - Delete stored sequence\n");
         sendResponse("SET|ELECTRODE|STATE - Set single electrode (STATE: 0=LOW, 1=HIGH)\n");
         sendResponse("ALL|STATE - Set all electrodes\n");
         sendResponse("ROW|ROW_NUM|STATE - Set all electrodes in row\n");
         sendResponse("COL|COL_NUM|STATE - Set all electrodes in column\n");
         sendResponse("TEST - Run full electrode test\n");
         sendResponse("STATUS - Get system status\n");
-        sendResponse("STOP - Stop current sequence\n");
+        sendResponse("STOP - Stop current sequence (and any sequence it preempted)\n");
+        sendResponse("PAUSE / RESUME - Pause and resume current sequence\n");
+        sendResponse("PREEMPT|ID_OR_NAME[|PRIORITY] - Interrupt current sequence, then resume it\n");
         sendResponse("GET|ELECTRODE - Get electrode state\n");
-        sendResponse("RELOAD - Reload JSON mappings\n");
+        sendResponse("RELOAD - Reload JSON mappings (swapped at the next step edge)\n");
+        sendResponse("MAPCHECK - Check the mapping in use (unmapped and shared pins/cells)\n");
+        sendResponse("STAGE|ELECTRODE|STATE - Stage electrode change (applied by COMMIT)\n");
+        sendResponse("COMMIT - Apply staged changes in one transition\n");
+        sendResponse("DISCARD - Drop staged changes\n");
+        sendResponse("FRAME[|W0|...|W9] - Get/set whole array as 10 hex row words\n");
+        sendResponse("BENCH - Benchmark GPIO write paths and mapping parse (CPU cycles)\n");
         sendResponse("HELP - Show this help\n\n");
     }
     else {
@@ -138,6 +297,9 @@ void UartCommandHandler::parseCommand(char* cmd) {
 
 // Parse electrode sequence command
 // Format: START|REPS|DELAY|STEPS|ID1,DUR1|ID2,DUR2|...|END
+// IDn is one electrode or a set joined with '+' (e.g. 10+20+30); each step
+// shows exactly its set, so the previous step's electrodes turn off.
+// DURn is in milliseconds, or in microseconds when suffixed with "us"
 void UartCommandHandler::parseElectrodeCommand(char* cmd) {
     // Check start marker
     if (strncmp(cmd, "START|", 6) != 0) {
@@ -145,22 +307,34 @@ void UartCommandHandler::parseElectrodeCommand(char* cmd) {
         return;
     }
     
-    int cycleReps, cycleDelay, numSteps;
+    // Steps are stored in this handler; wait for the running sequence
+    if (arrayDriver->isSequenceRunning() || sequenceStream.isActive()) {
+        sendError("Sequence running (STOP first)");
+        return;
+    }
     
-    // Parse header: START|REPS|DELAY|STEPS|
-    char* ptr = cmd + 6; // Skip "START|"
+    if (parseSequence(cmd + 6)) { // Skip "START|"
+        startSequence();
+        sendOK();
+    }
+}
+
+// Parse "REPS|DELAY|STEPS|ID1,DUR1|...|END" into currentSequence
+// Sends the error and returns false on invalid input.
+bool UartCommandHandler::parseSequence(char* ptr) {
+    int cycleReps, cycleDelay, numSteps;
     
     // Parse cycle repetitions
     cycleReps = atoi(ptr);
     if (cycleReps < 1 || cycleReps > 1000) {
         sendError("Invalid cycle repetitions (1-1000)");
-        return;
+        return false;
     }
     
     ptr = strchr(ptr, '|');
     if (!ptr) {
         sendError("Missing delimiter after REPS");
-        return;
+        return false;
     }
     ptr++; // Skip '|'
     
@@ -168,70 +342,48 @@ void UartCommandHandler::parseElectrodeCommand(char* cmd) {
     cycleDelay = atoi(ptr);
     if (cycleDelay < 0) {
         sendError("Invalid cycle delay");
-        return;
+        return false;
     }
     
     ptr = strchr(ptr, '|');
     if (!ptr) {
         sendError("Missing delimiter after DELAY");
-        return;
+        return false;
     }
     ptr++; // Skip '|'
     
     // Parse number of steps
     numSteps = atoi(ptr);
     if (numSteps < 1 || numSteps > MAX_STEPS) {
-        snprintf(responseBuffer, sizeof(responseBuffer), 
-                "Invalid steps count (1-%d)", MAX_STEPS);
-        sendError(responseBuffer);
-        return;
+        char msg[48];
+        snprintf(msg, sizeof(msg), "Invalid steps count (1-%d)", MAX_STEPS);
+        sendError(msg);
+        return false;
     }
     
     ptr = strchr(ptr, '|');
     if (!ptr) {
         sendError("Missing delimiter after STEPS");
-        return;
+        return false;
     }
     ptr++; // Skip '|'
     
-    // Parse electrode steps
-    int electrodeIds[MAX_STEPS];
-    int durations[MAX_STEPS];
-    
+    // Parse electrode steps (one frame transition each)
     for (int i = 0; i < numSteps; i++) {
-        // Parse electrode ID
-        electrodeIds[i] = atoi(ptr);
-        
-        if (electrodeIds[i] < 1 || electrodeIds[i] > 140) {
-            snprintf(responseBuffer, sizeof(responseBuffer), 
-                    "Invalid electrode ID at step %d (1-140)", i);
-            sendError(responseBuffer);
-            return;
-        }
-        
-        // Find comma
-        ptr = strchr(ptr, ',');
-        if (!ptr) {
-            sendError("Missing comma in step");
-            return;
-        }
-        ptr++; // Skip ','
-        
-        // Parse duration
-        durations[i] = atoi(ptr);
-        
-        if (durations[i] < 0) {
-            snprintf(responseBuffer, sizeof(responseBuffer), 
-                    "Invalid duration at step %d", i);
-            sendError(responseBuffer);
-            return;
+        uint32_t duration;
+        if (!parseStep(&ptr, i, &stepFrames[i], &duration)) {
+            return false;
         }
+        memset(&sequenceSteps[i], 0, sizeof(ElectrodeStep_t));
+        sequenceSteps[i].frame = &stepFrames[i];
+        sequenceSteps[i].duration_ms = duration / 1000;
+        sequenceSteps[i].duration_us = duration % 1000;
         
         // Find next pipe or END
         ptr = strchr(ptr, '|');
         if (!ptr) {
             sendError("Missing delimiter");
-            return;
+            return false;
         }
         ptr++; // Skip '|'
         
@@ -239,47 +391,425 @@ void UartCommandHandler::parseElectrodeCommand(char* cmd) {
         if (strncmp(ptr, "END", 3) == 0) {
             if (i + 1 == numSteps) {
                 // Successfully parsed all steps
-                executeSequence(cycleReps, cycleDelay, numSteps, 
-                               electrodeIds, durations);
-                sendOK();
-                return;
+                currentSequence.steps = sequenceSteps;
+                currentSequence.numSteps = numSteps;
+                currentSequence.cycleCount = cycleReps;
+                currentSequence.cycleDelay_ms = cycleDelay;
+                return true;
             } else {
                 sendError("Early END marker");
-                return;
+                return false;
             }
         }
     }
     
     sendError("Missing END marker");
+    return false;
 }
 
-// Execute sequence from parsed data
-void UartCommandHandler::executeSequence(int cycleReps, int cycleDelay, 
-                                        int numSteps, int* electrodeIds, int* durations) {
-    // Build sequence steps
-    for (int i = 0; i < numSteps; i++) {
-        uint8_t row, col;
-        if (arrayDriver->getRowColFromElectrode(electrodeIds[i], &row, &col)) {
-            sequenceSteps[i].row = row;
-            sequenceSteps[i].col = col;
-            sequenceSteps[i].state = true;  // Turn on
-            sequenceSteps[i].duration_ms = durations[i];
-        } else {
-            sendError("Invalid electrode number");
+// Parse stream command
+// Format: STREAM|BEGIN, STREAM|ID1,DUR1|ID2,DUR2|..., STREAM|END, STREAM|ABORT
+// A chunk is accepted as a whole or rejected; the reply reports the free
+// ring space so the host never sends more than fits.
+void UartCommandHandler::parseStreamCommand(char* cmd) {
+    char* ptr = cmd + 7; // Skip "STREAM|"
+    
+    if (strncmp(ptr, "BEGIN", 5) == 0) {
+        if (!sequenceStream.begin()) {
+            sendError("Sequence running (STOP first)");
+            return;
+        }
+        streamLowReported = false;
+        streamEnded = false;
+    }
+    else if (strncmp(ptr, "END", 3) == 0) {
+        if (!sequenceStream.isActive()) {
+            sendError("No stream open");
+            return;
+        }
+        sequenceStream.end();
+        streamEnded = true;  // update() reports completion
+        sendOK();
+        return;
+    }
+    else if (strncmp(ptr, "ABORT", 5) == 0) {
+        sequenceStream.abort();
+        streamEnded = false;
+        sendOK();
+        return;
+    }
+    else {
+        if (!sequenceStream.isActive()) {
+            sendError("No stream open (STREAM|BEGIN first)");
+            return;
+        }
+        
+        // First pass validates and counts, second pass pushes
+        ElectrodeFrame_t frame;
+        uint32_t duration;
+        int count = 0;
+        for (char* scan = ptr; *scan != '\0' && *scan != '\r'; count++) {
+            if (!parseStep(&scan, count, &frame, &duration)) {
+                return;
+            }
+            if (*scan == '|') {
+                scan++;
+            }
+        }
+        if (count == 0 || count > sequenceStream.getFree()) {
+            snprintf(responseBuffer, sizeof(responseBuffer),
+                    "ERROR: Stream buffer full (%d steps, %u free)\n", count, sequenceStream.getFree());
+            sendResponse(responseBuffer);
             return;
         }
+        for (int i = 0; i < count; i++) {
+            parseStep(&ptr, i, &frame, &duration);
+            sequenceStream.push(&frame, duration);
+            if (*ptr == '|') {
+                ptr++;
+            }
+        }
+        streamLowReported = false;
     }
     
-    // Configure sequence
-    currentSequence.steps = sequenceSteps;
-    currentSequence.numSteps = numSteps;
-    currentSequence.cycleCount = cycleReps;
-    currentSequence.cycleDelay_ms = cycleDelay;
+    snprintf(responseBuffer, sizeof(responseBuffer), "STREAM|FREE|%u\n", sequenceStream.getFree());
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Parse one step "ID[+ID...],DUR[us]" into a frame and a duration
+// Leaves 'cursor' after the duration; sends the error and returns false
+// on invalid input.
+bool UartCommandHandler::parseStep(char** cursor, int index, ElectrodeFrame_t* frame, uint32_t* duration_us) {
+    char* ptr = *cursor;
     
-    // Execute sequence
+    // Parse electrode set into the step's frame
+    frameClear(frame);
+    while (true) {
+        int electrodeId = atoi(ptr);
+        uint8_t row, col;
+        
+        if (electrodeId < 1 || electrodeId > 140 ||
+            !arrayDriver->getRowColFromElectrode(electrodeId, &row, &col)) {
+            char msg[48];
+            snprintf(msg, sizeof(msg), "Invalid electrode ID at step %d (1-140)", index);
+            sendError(msg);
+            return false;
+        }
+        frameSet(frame, row, col, true);
+        
+        ptr += strspn(ptr, "0123456789");
+        if (*ptr != '+') {
+            break;
+        }
+        ptr++; // Skip '+'
+    }
+    
+    // Find comma
+    if (*ptr != ',') {
+        sendError("Missing comma in step");
+        return false;
+    }
+    ptr++; // Skip ','
+    
+    // Parse duration (ms, or us with a "us" suffix)
+    char* end;
+    long duration = strtol(ptr, &end, 10);
+    if (strncmp(end, "us", 2) == 0) {
+        end += 2;
+    } else {
+        duration = (duration > 2000000L) ? -1 : duration * 1000L;
+    }
+    
+    if (end == ptr || duration < 0 || duration > 2000000000L) {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "Invalid duration at step %d", index);
+        sendError(msg);
+        return false;
+    }
+    
+    *duration_us = (uint32_t)duration;
+    *cursor = end;
+    return true;
+}
+
+// Start currentSequence
+void UartCommandHandler::startSequence() {
+    // Start sequence; update() advances it and reports completion
     sendResponse("Executing sequence...\n");
-    arrayDriver->executeSequence(&currentSequence);
-    sendResponse("Sequence complete\n");
+    if (sequenceTimer) {
+        arrayDriver->executeSequenceTimed(sequenceTimer, &currentSequence);
+    } else {
+        arrayDriver->executeSequenceAsync(&currentSequence);
+    }
+    sequenceStarted = true;
+}
+
+// Describe a library error
+static const char* libraryErrorText(LibraryError_t error) {
+    switch (error) {
+        case LIBRARY_ERR_INVALID: return "Invalid id or name (id 1-65534, name 1-15 chars)";
+        case LIBRARY_ERR_NAME: return "Name used by another id";
+        case LIBRARY_ERR_ENTRIES: return "Library full (too many sequences)";
+        case LIBRARY_ERR_FULL: return "Library full (not enough flash)";
+        case LIBRARY_ERR_FLASH: return "Flash write failed";
+        case LIBRARY_ERR_NOT_FOUND: return "Sequence not found";
+        default: return "Library error";
+    }
+}
+
+// Parse store command
+// Format: STORE|ID|NAME|REPS|DELAY|STEPS|ID1,DUR1|...|END
+// Same sequence format as START; the sequence is saved, not run.
+void UartCommandHandler::parseStoreCommand(char* cmd) {
+    // Flash erase stalls the CPU; the parse also reuses the START buffers
+    if (arrayDriver->isSequenceRunning() || sequenceStream.isActive()) {
+        sendError("Sequence running (STOP first)");
+        return;
+    }
+    
+    char* ptr = cmd + 6; // Skip "STORE|"
+    
+    int id = atoi(ptr);
+    ptr = strchr(ptr, '|');
+    if (!ptr) {
+        sendError("Missing delimiter after ID");
+        return;
+    }
+    ptr++; // Skip '|'
+    
+    char* name = ptr;
+    ptr = strchr(ptr, '|');
+    if (!ptr) {
+        sendError("Missing delimiter after NAME");
+        return;
+    }
+    *ptr++ = '\0'; // Terminate NAME
+    
+    if (id < 1 || id > 65534 || strlen(name) >= SEQLIB_NAME_LEN || name[0] == '\0' ||
+        (name[0] >= '0' && name[0] <= '9')) {
+        sendError("Invalid id or name (id 1-65534, name 1-15 chars, not starting with a digit)");
+        return;
+    }
+    
+    if (!parseSequence(ptr)) {
+        return;
+    }
+    
+    LibraryError_t error = sequenceLibrary.store((uint16_t)id, name, &currentSequence);
+    if (error != LIBRARY_OK) {
+        sendError(libraryErrorText(error));
+        return;
+    }
+    
+    LibraryUsage_t usage;
+    sequenceLibrary.getUsage(&usage);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Stored '%s' as id %d (%u steps, %lu bytes free)\n", name, id,
+            currentSequence.numSteps, (unsigned long)usage.freeBytes);
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Parse run command
+// Format: RUN|ID or RUN|NAME
+// Starts a stored sequence or a TestScenarios.json scenario (library names
+// first) without parsing any steps.
+void UartCommandHandler::parseRunCommand(char* cmd) {
+    if (arrayDriver->isSequenceRunning() || sequenceStream.isActive()) {
+        sendError("Sequence running (STOP first)");
+        return;
+    }
+    
+    char* ptr = cmd + 4; // Skip "RUN|"
+    ptr[strcspn(ptr, "\r ")] = '\0';
+    
+    uint16_t id;
+    if (!loadSequence(ptr, sequenceSteps, MAX_STEPS, &currentSequence, &id)) {
+        sendError(libraryErrorText(LIBRARY_ERR_NOT_FOUND));
+        return;
+    }
+    
+    if (id == 0) {
+        snprintf(responseBuffer, sizeof(responseBuffer), "Running scenario %s (%u steps, %lu cycles)\n",
+                ptr, currentSequence.numSteps, (unsigned long)currentSequence.cycleCount);
+    } else {
+        snprintf(responseBuffer, sizeof(responseBuffer), "Running id %u (%u steps, %lu cycles)\n",
+                id, currentSequence.numSteps, (unsigned long)currentSequence.cycleCount);
+    }
+    sendResponse(responseBuffer);
+    startSequence();
+    sendOK();
+}
+
+// Look up a sequence by library id, library name or scenario name
+// Library names are searched before scenarios. Library steps are built into
+// 'steps'; a scenario's compiled sequence is used as it is.
+bool UartCommandHandler::loadSequence(const char* ref, ElectrodeStep_t* steps, uint16_t maxSteps,
+                                      ElectrodeSequence_t* sequence, uint16_t* id) {
+    if (*ref >= '0' && *ref <= '9') {
+        *id = (uint16_t)atoi(ref);
+    } else if (!sequenceLibrary.findByName(ref, id)) {
+        const ElectrodeSequence_t* compiled = scenarios.find(ref);
+        if (!compiled) {
+            return false;
+        }
+        *sequence = *compiled;
+        *id = 0;
+        return true;
+    }
+    return *id != 0 && sequenceLibrary.load(*id, steps, maxSteps, sequence);
+}
+
+// Parse pause command
+// The current step keeps the time it had left until RESUME
+void UartCommandHandler::parsePauseCommand(char* cmd) {
+    if (!arrayDriver->pauseSequence()) {
+        sendError(arrayDriver->isSequenceRunning() ? "Sequence already paused" : "No sequence running");
+        return;
+    }
+    
+    SequenceProgress_t progress;
+    arrayDriver->getSequenceProgress(&progress);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Sequence paused at cycle %lu/%lu, step %u/%u (%lu ms left in step)\n",
+            (unsigned long)progress.cycle + 1, (unsigned long)progress.cycleCount,
+            progress.step + 1, progress.numSteps, (unsigned long)progress.stepRemaining_ms);
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Parse resume command
+void UartCommandHandler::parseResumeCommand(char* cmd) {
+    if (!arrayDriver->resumeSequence()) {
+        sendError(arrayDriver->isSequenceRunning() ? "Sequence not paused" : "No sequence running");
+        return;
+    }
+    
+    sendResponse("Sequence resumed\n");
+    sendOK();
+}
+
+// Parse preempt command
+// Format: PREEMPT|ID_OR_NAME[|PRIORITY]
+// Runs a stored sequence or scenario in place of the current one; the
+// interrupted sequence resumes where it was when the urgent one ends.
+// PRIORITY (1-255, default 1) must be above that of the running sequence.
+void UartCommandHandler::parsePreemptCommand(char* cmd) {
+    if (sequenceStream.isActive()) {
+        sendError("Stream running (STOP first)");
+        return;
+    }
+    
+    char* ptr = cmd + 8; // Skip "PREEMPT|"
+    int priority = 1;
+    char* sep = strchr(ptr, '|');
+    if (sep) {
+        *sep = '\0';
+        priority = atoi(sep + 1);
+    }
+    ptr[strcspn(ptr, "\r ")] = '\0';
+    
+    if (priority < 1 || priority > 255) {
+        sendError("Invalid priority (1-255)");
+        return;
+    }
+    
+    // Reject before loading: a rejected PREEMPT must leave every sequence
+    // the driver runs or has saved untouched
+    SequenceProgress_t progress;
+    arrayDriver->getSequenceProgress(&progress);
+    if (progress.running && progress.preempted >= SEQUENCE_PREEMPT_DEPTH) {
+        sendError("Too many preempted sequences");
+        return;
+    }
+    if (progress.running && priority <= progress.priority) {
+        sendError("Priority not above the running sequence");
+        return;
+    }
+    
+    // At most SEQUENCE_PREEMPT_DEPTH runs exist here, so a slot is free
+    uint8_t slot = 0;
+    while (slot < SEQUENCE_PREEMPT_DEPTH && arrayDriver->isSequenceInUse(&urgentSequence[slot])) {
+        slot++;
+    }
+    
+    uint16_t id;
+    if (!loadSequence(ptr, urgentSteps[slot], PREEMPT_MAX_STEPS, &urgentSequence[slot], &id)) {
+        sendError("Sequence not found (library sequences: up to 32 steps)");
+        return;
+    }
+    
+    bool wasRunning = progress.running;
+    if (!arrayDriver->preemptSequence(&urgentSequence[slot], (uint8_t)priority)) {
+        sendError("Priority not above the running sequence");
+        return;
+    }
+    
+    snprintf(responseBuffer, sizeof(responseBuffer), "%s %s (priority %d, %u steps)\n",
+            wasRunning ? "Preempted by" : "Running", ptr, priority, urgentSequence[slot].numSteps);
+    sendResponse(responseBuffer);
+    sequenceStarted = true;
+    preemptedRuns = wasRunning ? progress.preempted + 1 : 0;
+    sendOK();
+}
+
+// Parse library command
+// Lists the stored sequences and the flash usage
+void UartCommandHandler::parseLibraryCommand(char* cmd) {
+    sendResponse("\n=== Sequence Library ===\n");
+    
+    LibraryEntry_t entry;
+    for (uint8_t i = 0; sequenceLibrary.getEntry(i, &entry); i++) {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "%u|%s|%u steps|%lu cycles|%lu ms delay|%lu bytes\n",
+                entry.id, entry.name, entry.numSteps, (unsigned long)entry.cycleCount,
+                (unsigned long)entry.cycleDelay_ms, (unsigned long)entry.bytes);
+        sendResponse(responseBuffer);
+    }
+    
+    LibraryUsage_t usage;
+    sequenceLibrary.getUsage(&usage);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "%u sequences, %lu/%lu bytes used, %lu reclaimable, %lu free (generation %lu)\n\n",
+            usage.sequences, (unsigned long)usage.usedBytes, (unsigned long)usage.totalBytes,
+            (unsigned long)usage.reclaimableBytes, (unsigned long)usage.freeBytes,
+            (unsigned long)usage.generation);
+    sendResponse(responseBuffer);
+    
+    for (uint8_t i = 0; i < scenarios.getCount(); i++) {
+        const Scenario_t* scenario = scenarios.getScenario(i);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Scenario|%s|%u steps|%lu cycles|%lu ms delay\n", scenario->name,
+                scenario->sequence.numSteps, (unsigned long)scenario->sequence.cycleCount,
+                (unsigned long)scenario->sequence.cycleDelay_ms);
+        sendResponse(responseBuffer);
+    }
+    if (scenarios.getCount() > 0) {
+        sendResponse("\n");
+    }
+    sendOK();
+}
+
+// Parse delete command
+// Format: DELETE|ID
+void UartCommandHandler::parseDeleteCommand(char* cmd) {
+    if (arrayDriver->isSequenceRunning() || sequenceStream.isActive()) {
+        sendError("Sequence running (STOP first)");
+        return;
+    }
+    
+    int id = atoi(cmd + 7); // Skip "DELETE|"
+    LibraryError_t error = (id >= 1 && id <= 65534) ? sequenceLibrary.remove((uint16_t)id)
+                                                    : LIBRARY_ERR_NOT_FOUND;
+    if (error != LIBRARY_OK) {
+        sendError(libraryErrorText(error));
+        return;
+    }
+    
+    snprintf(responseBuffer, sizeof(responseBuffer), "Deleted id %d\n", id);
+    sendResponse(responseBuffer);
+    sendOK();
 }
 
 // Parse single electrode command
@@ -292,6 +822,11 @@ void UartCommandHandler::parseSingleElectrodeCommand(char* cmd) {
         sendError("Invalid electrode (1-140)");
         return;
     }
+    uint8_t row, col;
+    if (!arrayDriver->getRowColFromElectrode(electrode, &row, &col)) {
+        sendError("Electrode not mapped (see MAPCHECK)");
+        return;
+    }
     
     ptr = strchr(ptr, '|');
     if (!ptr) {
@@ -408,20 +943,85 @@ void UartCommandHandler::parseTestCommand(char* cmd) {
     sendOK();
 }
 
+// Text of a mapping source
+static const char* mappingSourceText(MappingSource_t source) {
+    switch (source) {
+        case MAPPING_SOURCE_JSON: return "JSON files";
+        case MAPPING_SOURCE_IMAGE: return "compiled image";
+        case MAPPING_SOURCE_IMAGE_IN_PLACE: return "compiled image (in place)";
+        default: return "default 1:1 (mapping files not loaded)";
+    }
+}
+
 // Parse status command
 void UartCommandHandler::parseStatusCommand(char* cmd) {
     sendResponse("\n=== System Status ===\n");
     
     if (arrayDriver->isSequenceRunning()) {
-        sendResponse("Sequence: RUNNING\n");
+        SequenceProgress_t progress;
+        arrayDriver->getSequenceProgress(&progress);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Sequence: %s (cycle %lu/%lu, step %u/%u, step remaining %lu ms, total remaining %lu ms)\n",
+                progress.paused ? "PAUSED" : "RUNNING",
+                (unsigned long)progress.cycle + 1, (unsigned long)progress.cycleCount,
+                progress.step + 1, progress.numSteps,
+                (unsigned long)progress.stepRemaining_ms, (unsigned long)progress.totalRemaining_ms);
+        sendResponse(responseBuffer);
+        if (progress.preempted > 0) {
+            snprintf(responseBuffer, sizeof(responseBuffer),
+                    "Preempted sequences waiting: %u\n", progress.preempted);
+            sendResponse(responseBuffer);
+        }
+    } else if (sequenceStream.isActive()) {
+        StreamStatus_t stream;
+        sequenceStream.getStatus(&stream);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Sequence: STREAMING (%lu steps played, %u buffered, %u free, %lu underruns)\n",
+                (unsigned long)stream.stepsPlayed, stream.buffered, stream.free,
+                (unsigned long)stream.underruns);
+        sendResponse(responseBuffer);
     } else {
         sendResponse("Sequence: IDLE\n");
     }
     
+    SequenceTiming_t timing;
+    arrayDriver->getSequenceTiming(&timing);
+    if (timing.edges > 0) {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Step edge latency: max %lu us, avg %lu us, last %lu us (%lu edges)\n",
+                (unsigned long)timing.maxLatency_us, (unsigned long)timing.avgLatency_us,
+                (unsigned long)timing.endDrift_us, (unsigned long)timing.edges);
+        sendResponse(responseBuffer);
+    }
+    
     snprintf(responseBuffer, sizeof(responseBuffer), 
             "Electrodes: 140 (10 rows x 14 columns)\n");
     sendResponse(responseBuffer);
     
+    MappingReport_t mappingReport;
+    arrayDriver->getMappingReport(&mappingReport);
+    if (mappingReport.problems == 0) {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Mapping: %s, bijective\n", mappingSourceText(mappingReport.source));
+    } else {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Mapping: %s, %u problems (see MAPCHECK)\n",
+                mappingSourceText(mappingReport.source), mappingReport.problems);
+    }
+    sendResponse(responseBuffer);
+    
+    ElectrodeFrame_t frame;
+    arrayDriver->getPattern(&frame);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Active electrodes: %u\n", frameCount(&frame));
+    sendResponse(responseBuffer);
+    
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Longest masked interval: %lu cycles (%lu sections)\n",
+            (unsigned long)CriticalSection::getLongestCycles(),
+            (unsigned long)CriticalSection::getSectionCount());
+    sendResponse(responseBuffer);
+    
     sendResponse("Status: OK\n\n");
 }
 
@@ -429,7 +1029,13 @@ void UartCommandHandler::parseStatusCommand(char* cmd) {
 void UartCommandHandler::parseStopCommand(char* cmd) {
     if (arrayDriver->isSequenceRunning()) {
         arrayDriver->stopSequence();
+        sequenceStarted = false;
+        preemptedRuns = 0;
         sendResponse("Sequence stopped\n");
+    } else if (sequenceStream.isActive()) {
+        sequenceStream.abort();
+        streamEnded = false;
+        sendResponse("Stream stopped\n");
     } else {
         sendResponse("No sequence running\n");
     }
@@ -460,9 +1066,279 @@ void UartCommandHandler::parseGetStateCommand(char* cmd) {
     }
 }
 
+// Text of a mapping reload error
+static const char* mappingReloadErrorText(MappingReloadError_t error) {
+    switch (error) {
+        case MAPPING_RELOAD_ERR_BUSY: return "Previous mapping swap still pending";
+        case MAPPING_RELOAD_ERR_ELECTRODE_MAP: return "ElectrodeMap.json missing or invalid";
+        case MAPPING_RELOAD_ERR_PIN_MAP: return "PinMap.json missing or invalid";
+        case MAPPING_RELOAD_ERR_INVALID: return "Mapping is not a bijection or out of range";
+        default: return "Reload failed";
+    }
+}
+
 // Parse reload mapping command
+// ElectrodeMap.json and PinMap.json are parsed into the driver's shadow
+// tables while sequences keep playing; the new mapping takes over at the
+// next step edge (at once when idle). Electrode states are kept.
 void UartCommandHandler::parseReloadMappingCommand(char* cmd) {
-    sendResponse("Reload mapping not implemented (requires re-initialization)\n");
-    sendError("Not implemented");
+    MappingReload_t reload;
+    MappingReloadError_t error = arrayDriver->reloadMapping(&reload, serviceDuringReload, this);
+    if (error == MAPPING_RELOAD_ERR_INVALID || (error == MAPPING_RELOAD_OK && reload.check.problems > 0)) {
+        sendMappingReport(&reload.check);
+    }
+    if (error != MAPPING_RELOAD_OK) {
+        sendError(mappingReloadErrorText(error));
+        return;
+    }
+    
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Mapping parsed: %lu bytes in %lu ms (%lu cycles)\n",
+            (unsigned long)reload.bytes, (unsigned long)reload.parse_ms,
+            (unsigned long)reload.parseCycles);
+    sendResponse(responseBuffer);
+    
+    if (reload.swapPending) {
+        mappingSwapPending = true;
+        sendResponse("Mapping swap waiting for the next step edge\n");
+    } else {
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Mapping swapped: %lu cycles\n", (unsigned long)reload.swapCycles);
+        sendResponse(responseBuffer);
+    }
+    scenariosStale = true;
+    sendOK();
 }
 
+// Parse mapping check command
+// Reports the check the driver made when the mapping in use was loaded
+void UartCommandHandler::parseMapCheckCommand(char* cmd) {
+    MappingReport_t report;
+    arrayDriver->getMappingReport(&report);
+    sendMappingReport(&report);
+    snprintf(responseBuffer, sizeof(responseBuffer), "Check: %lu cycles\n",
+            (unsigned long)report.checkCycles);
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Send a mapping check: a summary line, then one line per problem found
+void UartCommandHandler::sendMappingReport(const MappingReport_t* report) {
+    snprintf(responseBuffer, sizeof(responseBuffer), "Mapping: %s, %s, %u problems\n",
+            mappingSourceText(report->source), report->bijective ? "bijective" : "NOT bijective",
+            report->problems);
+    sendResponse(responseBuffer);
+    if (report->loadError != MAPPING_RELOAD_OK) {
+        snprintf(responseBuffer, sizeof(responseBuffer), "  Not loaded: %s\n",
+                mappingReloadErrorText(report->loadError));
+        sendResponse(responseBuffer);
+    }
+    
+    sendMappingProblem(report->electrodeEntriesIgnored, "ElectrodeMap entries ignored (out of range)", 0, false);
+    sendMappingProblem(report->electrodeDuplicates, "ElectrodeMap electrodes listed twice", 0, false);
+    sendMappingProblem(report->electrodesUnmapped, "electrodes without a PCIE pin",
+                       report->firstElectrodeUnmapped, false);
+    sendMappingProblem(report->pcieShared, "PCIE pins of several electrodes", report->firstPcieShared, false);
+    sendMappingProblem(report->pinEntriesIgnored, "PinMap entries ignored (out of range)", 0, false);
+    sendMappingProblem(report->pinDuplicates, "PinMap PCIE pins listed twice", 0, false);
+    sendMappingProblem(report->pcieUnmapped, "PCIE pins without a cell", report->firstPcieUnmapped, false);
+    sendMappingProblem(report->cellsUnassigned, "cells without a PCIE pin", report->firstCellUnassigned, true);
+    sendMappingProblem(report->electrodesUnresolved, "electrodes without a cell",
+                       report->firstElectrodeUnresolved, false);
+    sendMappingProblem(report->cellsShared, "cells of several electrodes", report->firstCellShared, true);
+    sendMappingProblem(report->cellsUnused, "cells of no electrode", report->firstCellUnused, true);
+}
+
+// One mapping check line (nothing if count is 0); 'first' is a number, or
+// with 'cell' a cell as row * NUM_COLS + col + 1
+void UartCommandHandler::sendMappingProblem(uint16_t count, const char* what, uint8_t first, bool cell) {
+    if (count == 0) {
+        return;
+    }
+    
+    if (first == 0) {
+        snprintf(responseBuffer, sizeof(responseBuffer), "  %u %s\n", count, what);
+    } else if (cell) {
+        snprintf(responseBuffer, sizeof(responseBuffer), "  %u %s (first %u,%u)\n", count, what,
+                (first - 1) / NUM_COLS, (first - 1) % NUM_COLS);
+    } else {
+        snprintf(responseBuffer, sizeof(responseBuffer), "  %u %s (first %u)\n", count, what, first);
+    }
+    sendResponse(responseBuffer);
+}
+
+// Reload yield: advance the tick-driven sequence and the stream between
+// file chunks
+void UartCommandHandler::serviceDuringReload(void* context) {
+    UartCommandHandler* handler = (UartCommandHandler*)context;
+    handler->arrayDriver->updateSequence();
+    handler->sequenceStream.update();
+}
+
+// Parse benchmark command
+// Times a checkerboard pattern through the per-electrode loop and the
+// per-port BSRR mask path, then leaves all electrodes LOW. Also times the
+// mapping parser on a 140- and a 1120-electrode map.
+void UartCommandHandler::parseBenchCommand(char* cmd) {
+    // The benchmark drives the outputs and leaves them all LOW
+    if (arrayDriver->isSequenceRunning() || sequenceStream.isActive()) {
+        sendError("Sequence running (STOP first)");
+        return;
+    }
+    
+    ElectrodeFrame_t frame;
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        frame.rows[row] = (row % 2) ? 0x1555 : 0x2AAA;
+    }
+    
+    PatternBenchmark_t result;
+    arrayDriver->benchmarkPatternWrite(&frame, &result);
+    arrayDriver->setAllElectrodesLow();
+    
+    sendResponse("\n=== Pattern Write Benchmark ===\n");
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "setElectrode loop: %lu cycles (140 delta writes)\n",
+            (unsigned long)result.loopCycles);
+    sendResponse(responseBuffer);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Port mask write: %lu cycles (%u BSRR stores, 1 critical section)\n",
+            (unsigned long)result.maskCycles, result.portWrites);
+    sendResponse(responseBuffer);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Delta write (1 electrode toggled): %lu cycles (%u BSRR stores)\n",
+            (unsigned long)result.deltaCycles, result.deltaWrites);
+    sendResponse(responseBuffer);
+    
+    ElectrodeWriteBenchmark_t single;
+    arrayDriver->benchmarkElectrodeWrite(&single);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "setElectrode: %lu cycles, %lu instructions per call\n",
+            (unsigned long)single.runtimeCycles, (unsigned long)single.runtimeInstructions);
+    sendResponse(responseBuffer);
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "setElectrodeFixed<>: %lu cycles, %lu instructions per call\n",
+            (unsigned long)single.fixedCycles, (unsigned long)single.fixedInstructions);
+    sendResponse(responseBuffer);
+    
+    // Mapping parse time should grow linearly with the file size
+    const uint16_t mapSizes[] = {NUM_ELECTRODES, 1120};
+    for (uint8_t i = 0; i < 2; i++) {
+        MappingParseBenchmark_t parse;
+        arrayDriver->benchmarkMappingParse(mapSizes[i], &parse);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Mapping parse, %u electrodes (%lu bytes): %lu cycles (%lu cycles/byte)%s\n",
+                parse.entries, (unsigned long)parse.bytes, (unsigned long)parse.cycles,
+                (unsigned long)(parse.bytes ? parse.cycles / parse.bytes : 0),
+                parse.valid ? "" : " PARSE ERROR");
+        sendResponse(responseBuffer);
+    }
+    sendOK();
+}
+
+// Parse frame command
+// Format: FRAME                 (query: FRAME|W0|W1|...|W9)
+//         FRAME|W0|W1|...|W9    (set: one hex word per row, bit N = column N)
+void UartCommandHandler::parseFrameCommand(char* cmd) {
+    ElectrodeFrame_t frame;
+    
+    if (cmd[5] != '|') {
+        arrayDriver->getPattern(&frame);
+        int len = snprintf(responseBuffer, sizeof(responseBuffer), "FRAME");
+        for (uint8_t row = 0; row < NUM_ROWS; row++) {
+            len += snprintf(responseBuffer + len, sizeof(responseBuffer) - len,
+                           "|%04X", frame.rows[row]);
+        }
+        snprintf(responseBuffer + len, sizeof(responseBuffer) - len, "\n");
+        sendResponse(responseBuffer);
+        sendOK();
+        return;
+    }
+    
+    char* ptr = cmd + 6; // Skip "FRAME|"
+    for (uint8_t row = 0; row < NUM_ROWS; row++) {
+        char* end;
+        unsigned long word = strtoul(ptr, &end, 16);
+        if (end == ptr || word > FRAME_ROW_MASK) {
+            char msg[48];
+            snprintf(msg, sizeof(msg), "Invalid row word %d (0000-%04X)", row, FRAME_ROW_MASK);
+            sendError(msg);
+            return;
+        }
+        frame.rows[row] = (uint16_t)word;
+        
+        if (row + 1 < NUM_ROWS) {
+            if (*end != '|') {
+                sendError("Missing delimiter");
+                return;
+            }
+            ptr = end + 1;
+        }
+    }
+    
+    uint8_t writes = arrayDriver->setPattern(&frame);
+    
+    snprintf(responseBuffer, sizeof(responseBuffer),
+            "Frame set (%u electrodes active, %u port writes)\n", frameCount(&frame), writes);
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Parse stage command
+// Format: STAGE|ELECTRODE|STATE
+// Only the driver's back buffer changes; outputs are updated by COMMIT.
+void UartCommandHandler::parseStageCommand(char* cmd) {
+    char* ptr = cmd + 6; // Skip "STAGE|"
+    
+    int electrode = atoi(ptr);
+    if (electrode < 1 || electrode > 140) {
+        sendError("Invalid electrode (1-140)");
+        return;
+    }
+    uint8_t row, col;
+    if (!arrayDriver->getRowColFromElectrode(electrode, &row, &col)) {
+        sendError("Electrode not mapped (see MAPCHECK)");
+        return;
+    }
+    
+    ptr = strchr(ptr, '|');
+    if (!ptr) {
+        sendError("Missing delimiter");
+        return;
+    }
+    ptr++;
+    
+    int state = atoi(ptr);
+    if (state != 0 && state != 1) {
+        sendError("Invalid state (0=LOW, 1=HIGH)");
+        return;
+    }
+    
+    arrayDriver->stageElectrodeByNumber(electrode, state == 1);
+    
+    snprintf(responseBuffer, sizeof(responseBuffer), 
+            "Electrode %d staged %s\n", electrode, state ? "HIGH" : "LOW");
+    sendResponse(responseBuffer);
+    sendOK();
+}
+
+// Parse commit command
+// Applies all staged changes as one transition
+void UartCommandHandler::parseCommitCommand(char* cmd) {
+    if (arrayDriver->commit()) {
+        ElectrodeFrame_t frame;
+        arrayDriver->getPattern(&frame);
+        snprintf(responseBuffer, sizeof(responseBuffer),
+                "Committed (%u electrodes active)\n", frameCount(&frame));
+        sendResponse(responseBuffer);
+    } else {
+        sendResponse("Nothing staged\n");
+    }
+    sendOK();
+}
+
+// Parse discard command
+void UartCommandHandler::parseDiscardCommand(char* cmd) {
+    arrayDriver->discardStaged();
+    sendResponse("Staged changes discarded\n");
+    sendOK();
+}
@@ -0,0 +1,276 @@
+#include "WaveformPlayer.h"
+
+// Playback instance served by the DMA callbacks (one timer/DMA set)
+WaveformPlayer* WaveformPlayer::activePlayer = nullptr;
+
+// DMA request bit for each port's compare channel (port index i -> CH(i+1))
+static const uint32_t portDmaRequest[MAX_GPIO_PORTS] = {
+    TIM_DMA_CC1, TIM_DMA_CC2, TIM_DMA_CC3, TIM_DMA_CC4
+};
+static const uint32_t portChannel[MAX_GPIO_PORTS] = {
+    TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3, TIM_CHANNEL_4
+};
+static const uint32_t portDmaId[MAX_GPIO_PORTS] = {
+    TIM_DMA_ID_CC1, TIM_DMA_ID_CC2, TIM_DMA_ID_CC3, TIM_DMA_ID_CC4
+};
+
+// Constructor
+WaveformPlayer::WaveformPlayer(ArrayDriver* driver) {
+    arrayDriver = driver;
+    memset(&hw, 0, sizeof(hw));
+    sequence = nullptr;
+    cycle = 0;
+    step = 0;
+    frameClear(&frame);
+    holdTicks = 0;
+    compileDone = true;
+    playing = false;
+    handBackPending = false;
+    slotsFilled = 0;
+    slotsPlayed = 0;
+    endSlot = UINT32_MAX;
+}
+
+// ============================================================================
+// SEQUENCE COMPILER
+// ============================================================================
+
+// Produce the next sample from the sequence
+// Steps are applied cumulatively like ArrayDriver::executeSequence; the
+// cycle delay extends the last step of every cycle but the final one.
+// Zero-duration steps merge into the next timed step. Holds longer than
+// one timer period are split into repeated samples. Returns false once the
+// sequence is exhausted (the sample then repeats the final state).
+bool WaveformPlayer::nextSample(WaveformSample_t* sample) {
+    const uint32_t ticksPerMs = WAVEFORM_TIMER_CLOCK_HZ / 1000U;
+    
+    while (holdTicks == 0 && !compileDone) {
+        if (cycle >= sequence->cycleCount) {
+            compileDone = true;
+            arrayDriver->compileFrame(&frame, frameWords);
+            break;
+        }
+        
+        const ElectrodeStep_t* current = &sequence->steps[step];
+        stepApply(current, &frame);
+        holdTicks = (uint64_t)current->duration_ms * ticksPerMs +
+                    (uint64_t)current->duration_us * (ticksPerMs / 1000U);
+        
+        if (++step >= sequence->numSteps) {
+            step = 0;
+            cycle++;
+            if (cycle < sequence->cycleCount) {
+                holdTicks += (uint64_t)sequence->cycleDelay_ms * ticksPerMs;
+            }
+        }
+        
+        if (holdTicks > 0) {
+            arrayDriver->compileFrame(&frame, frameWords);
+        }
+    }
+    
+    memcpy(sample->bsrr, frameWords, sizeof(frameWords));
+    
+    if (holdTicks == 0) {
+        // Short padding so the end is detected within a buffer half
+        sample->ticks = WAVEFORM_PAD_TICKS;
+        return false;
+    }
+    
+    uint32_t chunk = (holdTicks > WAVEFORM_MAX_SAMPLE_TICKS) ? WAVEFORM_MAX_SAMPLE_TICKS : (uint32_t)holdTicks;
+    holdTicks -= chunk;
+    sample->ticks = chunk;
+    return true;
+}
+
+// Fill buffer slots
+// Slot k is transferred at update event k+1: its port words start the
+// sample after the one playing, its reload value is the hold time of the
+// sample after that (ARR is preloaded one period ahead).
+void WaveformPlayer::fillSlots(uint16_t first, uint16_t count) {
+    for (uint16_t k = first; k < first + count; k++) {
+        for (uint8_t i = 0; i < MAX_GPIO_PORTS; i++) {
+            portBuffer[i][k] = lookahead.bsrr[i];
+        }
+        
+        bool timed = nextSample(&lookahead);
+        if (!timed && endSlot == UINT32_MAX) {
+            // Port words of the following slot are the first padding sample
+            endSlot = slotsFilled + 1U;
+        }
+        reloadBuffer[k] = lookahead.ticks - 1U;
+        slotsFilled++;
+    }
+}
+
+// ============================================================================
+// PLAYBACK CONTROL
+// ============================================================================
+
+// Start playback
+bool WaveformPlayer::start(const WaveformHardware_t* hardware, const ElectrodeSequence_t* seq) {
+    if (!hardware || !hardware->htim || !hardware->reloadDma || playing) {
+        return false;
+    }
+    if (!seq || !seq->steps || seq->numSteps == 0 || seq->cycleCount == 0) {
+        return false;
+    }
+    if (arrayDriver->isScanning() || arrayDriver->isSequenceRunning()) {
+        return false;  // Row scanning or the driver's sequence owns the outputs
+    }
+    
+    // The driver frame must be current before it seeds the compiler
+    update();
+    
+    uint8_t numPorts = arrayDriver->getNumGpioPorts();
+    for (uint8_t i = 0; i < numPorts; i++) {
+        if (!hardware->portDma[i]) {
+            return false;
+        }
+    }
+    
+    hw = *hardware;
+    sequence = seq;
+    cycle = 0;
+    step = 0;
+    holdTicks = 0;
+    compileDone = false;
+    arrayDriver->getPattern(&frame);
+    arrayDriver->compileFrame(&frame, frameWords);
+    slotsFilled = 0;
+    slotsPlayed = 0;
+    endSlot = UINT32_MAX;
+    
+    // Sample 0 is written by the CPU, sample 1 primes the ARR preload
+    WaveformSample_t first;
+    if (!nextSample(&first)) {
+        return false;  // No timed steps
+    }
+    if (!nextSample(&lookahead)) {
+        endSlot = 0;
+    }
+    uint32_t firstReload = lookahead.ticks - 1U;
+    fillSlots(0, WAVEFORM_BUFFER_SAMPLES);
+    
+    TIM_HandleTypeDef* htim = hw.htim;
+    activePlayer = this;
+    
+    // ARR: sample 0 directly, sample 1 into the preload register
+    htim->Instance->CR1 &= ~TIM_CR1_ARPE;
+    __HAL_TIM_SET_AUTORELOAD(htim, first.ticks - 1U);
+    htim->Instance->CR1 |= TIM_CR1_ARPE;
+    __HAL_TIM_SET_AUTORELOAD(htim, firstReload);
+    __HAL_TIM_SET_COUNTER(htim, 0);
+    
+    // Reload stream drives the refill interrupts
+    htim->hdma[TIM_DMA_ID_UPDATE] = hw.reloadDma;
+    hw.reloadDma->Parent = htim;
+    hw.reloadDma->XferHalfCpltCallback = dmaHalfCompleteCallback;
+    hw.reloadDma->XferCpltCallback = dmaCompleteCallback;
+    HAL_DMA_Start_IT(hw.reloadDma, (uintptr_t)reloadBuffer,
+                     (uintptr_t)&htim->Instance->ARR, WAVEFORM_BUFFER_SAMPLES);
+    uint32_t requests = TIM_DMA_UPDATE;
+    
+    // One stream per port, fired by its compare channel at every update
+    for (uint8_t i = 0; i < numPorts; i++) {
+        __HAL_TIM_SET_COMPARE(htim, portChannel[i], 0);
+        htim->hdma[portDmaId[i]] = hw.portDma[i];
+        hw.portDma[i]->Parent = htim;
+        HAL_DMA_Start(hw.portDma[i], (uintptr_t)portBuffer[i],
+                      (uintptr_t)&arrayDriver->getGpioPort(i)->BSRR, WAVEFORM_BUFFER_SAMPLES);
+        requests |= portDmaRequest[i];
+    }
+    __HAL_TIM_ENABLE_DMA(htim, requests);
+    
+    // Sample 0 on the pins, then let the timer take over
+    arrayDriver->invalidateDrivenLines();
+    for (uint8_t i = 0; i < numPorts; i++) {
+        if (first.bsrr[i] != 0) {
+            arrayDriver->getGpioPort(i)->BSRR = first.bsrr[i];
+        }
+    }
+    playing = true;
+    HAL_TIM_Base_Start(htim);
+    
+    return true;
+}
+
+// Halt the timer and DMA streams
+void WaveformPlayer::stop() {
+    if (!playing) {
+        return;
+    }
+    
+    TIM_HandleTypeDef* htim = hw.htim;
+    HAL_TIM_Base_Stop(htim);
+    __HAL_TIM_DISABLE_DMA(htim, TIM_DMA_UPDATE | TIM_DMA_CC1 | TIM_DMA_CC2 | TIM_DMA_CC3 | TIM_DMA_CC4);
+    
+    HAL_DMA_Abort(hw.reloadDma);
+    for (uint8_t i = 0; i < arrayDriver->getNumGpioPorts(); i++) {
+        HAL_DMA_Abort(hw.portDma[i]);
+    }
+    
+    playing = false;
+}
+
+// Sequence fully played (DMA interrupt): stop, and leave the driver state
+// to update() so it is never written from here
+void WaveformPlayer::finish() {
+    stop();
+    handBackPending = true;
+}
+
+// Hand the final frame back to the driver
+void WaveformPlayer::update() {
+    if (!handBackPending) {
+        return;
+    }
+    
+    handBackPending = false;
+    arrayDriver->setPattern(&frame);
+}
+
+// Check if playback is active (or its final frame not yet handed back)
+bool WaveformPlayer::isPlaying() {
+    return playing || handBackPending;
+}
+
+// Number of samples whose output words have been written by DMA
+uint32_t WaveformPlayer::getSamplesPlayed() {
+    uint32_t played = slotsPlayed;
+    return (endSlot != UINT32_MAX && played > endSlot) ? endSlot : played;
+}
+
+// ============================================================================
+// DMA CALLBACKS (refill the half that just played)
+// ============================================================================
+
+void WaveformPlayer::dmaHalfCompleteCallback(DMA_HandleTypeDef* hdma) {
+    (void)hdma;
+    WaveformPlayer* player = activePlayer;
+    if (!player || !player->playing) {
+        return;
+    }
+    
+    player->slotsPlayed += WAVEFORM_BUFFER_SAMPLES / 2;
+    if (player->slotsPlayed > player->endSlot) {
+        player->finish();
+        return;
+    }
+    player->fillSlots(0, WAVEFORM_BUFFER_SAMPLES / 2);
+}
+
+void WaveformPlayer::dmaCompleteCallback(DMA_HandleTypeDef* hdma) {
+    (void)hdma;
+    WaveformPlayer* player = activePlayer;
+    if (!player || !player->playing) {
+        return;
+    }
+    
+    player->slotsPlayed += WAVEFORM_BUFFER_SAMPLES / 2;
+    if (player->slotsPlayed > player->endSlot) {
+        player->finish();
+        return;
+    }
+    player->fillSlots(WAVEFORM_BUFFER_SAMPLES / 2, WAVEFORM_BUFFER_SAMPLES / 2);
+}
@@ -0,0 +1,90 @@
+// Offline mapping compiler
+// Resolves ElectrodeMap.json -> PinMap.json -> PinDef.json with the driver's
+// own loader and writes the result as a binary mapping image
+// (MappingImage_t, see ArrayDriver.h). Copy the image to resources/Mapping.bin
+// on the target filesystem, or program it into flash at MAPPING_IMAGE_ADDR;
+// the driver then boots without parsing any JSON.
+//
+// Build and run on the host (paths relative to the firmware directory):
+//   g++ -std=c++17 -Isim -Iinclude -o mapc tools/MappingCompiler.cpp
+//       src/ArrayDriver.cpp src/JsonTokenizer.cpp src/CriticalSection.cpp sim/HostHal.cpp
+//   ./mapc [resource dir] [output file]
+// Defaults: resources, resources/Mapping.bin
+// Problems found by the mapping check are listed on stderr; the exit code is
+// 2 if the mapping is not a bijection (the image is still written).
+
+#include "ArrayDriver.h"
+
+int main(int argc, char** argv) {
+    const char* dir = (argc > 1) ? argv[1] : "resources";
+    const char* output = (argc > 2) ? argv[2] : "resources/Mapping.bin";
+    
+    char electrodeMapPath[256];
+    char pinMapPath[256];
+    char pinDefPath[256];
+    snprintf(electrodeMapPath, sizeof(electrodeMapPath), "%s/ElectrodeMap.json", dir);
+    snprintf(pinMapPath, sizeof(pinMapPath), "%s/PinMap.json", dir);
+    snprintf(pinDefPath, sizeof(pinDefPath), "%s/PinDef.json", dir);
+    
+    // The JSON files are read even if an older image exists
+    static ArrayDriver driver;
+    if (!driver.loadMappingJSON(electrodeMapPath, pinMapPath, pinDefPath)) {
+        fprintf(stderr, "Cannot load %s and %s\n", electrodeMapPath, pinMapPath);
+        return 1;
+    }
+    
+    MappingImage_t image;
+    driver.getMappingImage(&image);
+    
+    FILE* file = fopen(output, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot create %s\n", output);
+        return 1;
+    }
+    bool written = fwrite(&image, 1, sizeof(image), file) == sizeof(image);
+    written &= (fclose(file) == 0);
+    if (!written) {
+        fprintf(stderr, "Write to %s failed\n", output);
+        return 1;
+    }
+    
+    printf("%s: mapping image v%u, %u bytes, CRC 0x%08lX, %s pin layout\n",
+           output, image.header.version, image.header.size, (unsigned long)image.header.crc,
+           driver.hasCustomPinLayout() ? "PinDef.json" : "header macro");
+    
+    // The image is written either way; the driver reports the same at boot
+    MappingReport_t report;
+    driver.getMappingReport(&report);
+    if (report.problems == 0) {
+        printf("Mapping check: bijective\n");
+        return 0;
+    }
+    fprintf(stderr, "Mapping check: %s, %u problems\n",
+            report.bijective ? "bijective" : "NOT bijective", report.problems);
+    const struct { uint16_t count; const char* what; uint8_t first; bool cell; } lines[] = {
+        { report.electrodeEntriesIgnored, "ElectrodeMap entries ignored (out of range)", 0, false },
+        { report.electrodeDuplicates, "ElectrodeMap electrodes listed twice", 0, false },
+        { report.electrodesUnmapped, "electrodes without a PCIE pin", report.firstElectrodeUnmapped, false },
+        { report.pcieShared, "PCIE pins of several electrodes", report.firstPcieShared, false },
+        { report.pinEntriesIgnored, "PinMap entries ignored (out of range)", 0, false },
+        { report.pinDuplicates, "PinMap PCIE pins listed twice", 0, false },
+        { report.pcieUnmapped, "PCIE pins without a cell", report.firstPcieUnmapped, false },
+        { report.cellsUnassigned, "cells without a PCIE pin", report.firstCellUnassigned, true },
+        { report.electrodesUnresolved, "electrodes without a cell", report.firstElectrodeUnresolved, false },
+        { report.cellsShared, "cells of several electrodes", report.firstCellShared, true },
+        { report.cellsUnused, "cells of no electrode", report.firstCellUnused, true },
+    };
+    for (const auto& line : lines) {
+        if (line.count == 0) {
+            continue;
+        }
+        fprintf(stderr, "  %u %s", line.count, line.what);
+        if (line.first != 0 && line.cell) {
+            fprintf(stderr, " (first %u,%u)", (line.first - 1) / NUM_COLS, (line.first - 1) % NUM_COLS);
+        } else if (line.first != 0) {
+            fprintf(stderr, " (first %u)", line.first);
+        }
+        fprintf(stderr, "\n");
+    }
+    return report.bijective ? 0 : 2;
+}